@@ -3,7 +3,7 @@
     11/11/11
     Chris Lacher
 
-    BitVector class implementation - array of unsigned char version
+    BitVector class implementation - array of 64-bit words version
 
     Copyright 2011, R.C. Lacher
 */
@@ -12,6 +12,7 @@
 #define _BITVECT_CCP
 
 #include <iostream>
+#include <new>      // std::nothrow
 #include <bitvect.h>
 
 namespace fsu
@@ -42,35 +43,27 @@ namespace fsu
   }
 
   BitVector::BitVector (size_t numbits) // constructor
+    : superCount_(0), wordCount_(0), selectSample_(0), numSamples_(0)
   {
-    byteArraySize_ = (numbits + 7)/8;
-    if (byteArraySize_ == 0) byteArraySize_ = 1;
-    byteArray_ = new unsigned char [byteArraySize_];
-    if (byteArray_ == 0)
-    {
-      std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
-      exit (EXIT_FAILURE);
-    }
-    for (size_t i = 0; i < byteArraySize_; ++i)
-      byteArray_[i] = 0x00;
+    wordArraySize_ = (numbits + 63)/64;
+    if (wordArraySize_ == 0) wordArraySize_ = 1;
+    wordArray_ = NewArray(wordArraySize_);
+    Unset();
   }
 
   BitVector::BitVector (const BitVector& bv)  // copy constructor      
+    : superCount_(0), wordCount_(0), selectSample_(0), numSamples_(0)
   {
-    byteArraySize_ = bv.byteArraySize_;
-    byteArray_ = new unsigned char [byteArraySize_];
-    if (byteArray_ == 0)
-    {
-      std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
-      exit (EXIT_FAILURE);
-    }
-    for (size_t i = 0; i < byteArraySize_; ++i)
-      byteArray_[i] = bv.byteArray_[i];
+    wordArraySize_ = bv.wordArraySize_;
+    wordArray_ = NewArray(wordArraySize_);
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] = bv.wordArray_[i];
   }
 
   BitVector::~BitVector ()  // destructor
   {
-    delete [] byteArray_;
+    ClearIndex();
+    delete [] wordArray_;
   }
 
   BitVector& BitVector::operator = (const BitVector& bv)  
@@ -78,19 +71,15 @@ namespace fsu
   {
     if (this != &bv)
     {
-      if (byteArraySize_ != bv.byteArraySize_)
+      ClearIndex();
+      if (wordArraySize_ != bv.wordArraySize_)
       {
-	delete [] byteArray_;
-	byteArraySize_ = bv.byteArraySize_;
-	byteArray_ = new unsigned char [byteArraySize_];
-	if (byteArray_ == 0)
-	{
-	  std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
-	  exit (EXIT_FAILURE);
-	}
+	delete [] wordArray_;
+	wordArraySize_ = bv.wordArraySize_;
+	wordArray_ = NewArray(wordArraySize_);
       }
-      for (size_t i = 0; i < byteArraySize_; ++i)
-	byteArray_[i] = bv.byteArray_[i];
+      for (size_t i = 0; i < wordArraySize_; ++i)
+	wordArray_[i] = bv.wordArray_[i];
     }
     return *this;
   }
@@ -98,62 +87,240 @@ namespace fsu
   size_t BitVector::Size() const      
   // return size of bitvector
   {
-    return 8 * byteArraySize_;
+    return wordBits * wordArraySize_;
   }
 
   void BitVector::Set ()  
   // make all bits = 1
   {
-    for (size_t i = 0; i < byteArraySize_; ++i)
-      byteArray_[i] = 0xFF;
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] = ~(WordType)0;
   }
 
   void BitVector::Set (size_t index)  
   // make bit = 1: OR with mask
   {
-    byteArray_[ByteNumber(index)] |= Mask(index);
+    if (superCount_ != 0) ClearIndex();
+    wordArray_[WordNumber(index)] |= Mask(index);
   }
 
   void BitVector::Unset ()  
   // make all bits = 0
   {
-    for (size_t i = 0; i < byteArraySize_; ++i)
-      byteArray_[i] = 0x00;
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] = 0;
   }
 
   void BitVector::Unset (size_t index)  
   // make bit = 0: AND with inverted mask
   {
-    byteArray_[ByteNumber(index)] &= ~ Mask(index);
+    if (superCount_ != 0) ClearIndex();
+    wordArray_[WordNumber(index)] &= ~ Mask(index);
   }
 
   void BitVector::Flip ()  
   // change all bit values
   {
-    for (size_t i = 0; i < byteArraySize_; ++i)
-      byteArray_[i] ^= 0xFF;
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] = ~wordArray_[i];
   }
 
   void BitVector::Flip (size_t index)  
   // change bit value: XOR with mask
   {
-    byteArray_[ByteNumber(index)] ^= Mask(index);
+    if (superCount_ != 0) ClearIndex();
+    wordArray_[WordNumber(index)] ^= Mask(index);
   }
 
   bool BitVector::Test  (size_t index) const  
   // return bit value
   {
-    return 0 != (byteArray_[ByteNumber(index)] & Mask(index));
+    return 0 != (wordArray_[WordNumber(index)] & Mask(index));
+  }
+
+  size_t BitVector::Count () const
+  // return number of 1 bits
+  {
+    size_t count = 0;
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      count += PopCount(wordArray_[i]);
+    return count;
+  }
+
+  size_t BitVector::FindFirst () const
+  // return index of first 1 bit, or Size() if there is none
+  {
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      if (wordArray_[i] != 0)
+	return wordBits * i + LowBit(wordArray_[i]);
+    return Size();
+  }
+
+  size_t BitVector::FindNext (size_t index) const
+  // return index of first 1 bit strictly after index, or Size() if there is none
+  {
+    ++index;
+    if (index >= Size())
+      return Size();
+    size_t   i = index >> 6;
+    WordType w = wordArray_[i] & (~(WordType)0 << (index & (size_t)0x3F)); // drop bits below index
+    while (w == 0)
+    {
+      if (++i == wordArraySize_)
+	return Size();
+      w = wordArray_[i];
+    }
+    return wordBits * i + LowBit(w);
+  }
+
+  BitVector& BitVector::And (const BitVector& bv)
+  {
+    CheckSize(bv);
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] &= bv.wordArray_[i];
+    return *this;
+  }
+
+  BitVector& BitVector::Or (const BitVector& bv)
+  {
+    CheckSize(bv);
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] |= bv.wordArray_[i];
+    return *this;
+  }
+
+  BitVector& BitVector::Xor (const BitVector& bv)
+  {
+    CheckSize(bv);
+    if (superCount_ != 0) ClearIndex();
+    for (size_t i = 0; i < wordArraySize_; ++i)
+      wordArray_[i] ^= bv.wordArray_[i];
+    return *this;
   }
    
+  size_t BitVector::Rank1 (size_t index) const
+  // return number of 1 bits at positions < index
+  {
+    BuildIndex();
+    if (index >= Size())
+      return superCount_[(wordArraySize_ + 7) >> 3];
+    size_t   w    = index >> 6;
+    WordType part = wordArray_[w] & (Mask(index) - 1); // bits below index in its word
+    return superCount_[w >> 3] + wordCount_[w] + PopCount(part);
+  }
+
+  size_t BitVector::Select1 (size_t k) const
+  // return index of the 1 bit preceded by exactly k 1 bits, or Size() if Count() <= k
+  {
+    BuildIndex();
+    const size_t numSuper = (wordArraySize_ + 7) >> 3;
+    if (k >= superCount_[numSuper])
+      return Size();
+
+    // the sample directory brackets the superblock; binary search within the bracket
+    size_t lo = selectSample_[k >> 9];
+    size_t hi = ((k >> 9) + 1 < numSamples_) ? selectSample_[(k >> 9) + 1] + 1 : numSuper;
+    while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (superCount_[mid] <= k)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+    // scan the (at most 8) words of superblock lo
+    k -= superCount_[lo];
+    size_t w = lo << 3;
+    size_t last = w + 8 < wordArraySize_ ? w + 8 : wordArraySize_;
+    while (w + 1 < last && wordCount_[w + 1] <= k)
+      ++w;
+    return wordBits * w + SelectInWord(wordArray_[w], k - wordCount_[w]);
+  }
+
+  void BitVector::BuildIndex () const
+  // makes Rank1 and Select1 read-only until the next mutation
+  {
+    if (superCount_ == 0) MakeIndex();
+  }
+
   // private methods
 
-  size_t BitVector::ByteNumber (size_t index) const
+  void BitVector::MakeIndex () const
+  // builds the rank/select directory for the current bit values
   {
-    // return index / 8
-    // shift right 3 is equivalent to, and faster than, dividing by 8
-    index = index >> 3;
-    if (index >= byteArraySize_)
+    ClearIndex();
+    const size_t numSuper = (wordArraySize_ + 7) >> 3;
+    superCount_ = new(std::nothrow) size_t [numSuper + 1];
+    wordCount_  = new(std::nothrow) uint16_t [wordArraySize_];
+    if (superCount_ == 0 || wordCount_ == 0)
+    {
+      std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
+      exit (EXIT_FAILURE);
+    }
+
+    size_t total = 0;
+    for (size_t s = 0; s < numSuper; ++s)
+    {
+      superCount_[s] = total;
+      size_t local = 0;
+      for (size_t w = s << 3; w < (s << 3) + 8 && w < wordArraySize_; ++w)
+      {
+	wordCount_[w] = (uint16_t)local;
+	local += PopCount(wordArray_[w]);
+      }
+      total += local;
+    }
+    superCount_[numSuper] = total;
+
+    // sample the superblock holding every 512th 1 bit
+    numSamples_ = (total + 511) >> 9;
+    selectSample_ = new(std::nothrow) size_t [numSamples_ + 1];
+    if (selectSample_ == 0)
+    {
+      std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
+      exit (EXIT_FAILURE);
+    }
+    size_t s = 0;
+    for (size_t j = 0; j < numSamples_; ++j)
+    {
+      while (superCount_[s + 1] <= (j << 9))
+	++s;
+      selectSample_[j] = s;
+    }
+  }
+
+  void BitVector::ClearIndex () const
+  {
+    delete [] superCount_;
+    delete [] wordCount_;
+    delete [] selectSample_;
+    superCount_   = 0;
+    wordCount_    = 0;
+    selectSample_ = 0;
+    numSamples_   = 0;
+  }
+
+  size_t BitVector::SelectInWord (WordType w, size_t k)
+  {
+    // clear the k lowest 1 bits, then locate the lowest remaining one
+    while (k-- > 0)
+      w &= w - 1;
+    return LowBit(w);
+  }
+
+
+  size_t BitVector::WordNumber (size_t index) const
+  {
+    // return index / 64
+    // shift right 6 is equivalent to, and faster than, dividing by 64
+    index = index >> 6;
+    if (index >= wordArraySize_)
     {
       std::cerr << "** BitVector error: index out of range\n";
       exit (EXIT_FAILURE);
@@ -161,12 +328,54 @@ namespace fsu
     return index;
   }
 
-  unsigned char BitVector::Mask (size_t index)
+  BitVector::WordType BitVector::Mask (size_t index)
+  {
+    // return mask for index % 64
+    // the low order 6 bits is the remainder when dividing by 64
+    size_t shiftamount = index & (size_t)0x3F;  // low order 6 bits
+    return (WordType)0x01 << shiftamount;
+  }
+
+  size_t BitVector::PopCount (WordType w)
+  {
+#if defined(__GNUC__)
+    return (size_t)__builtin_popcountll(w);
+#else
+    // SWAR bit count
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (size_t)((w * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  size_t BitVector::LowBit (WordType w)
+  {
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(w);
+#else
+    return PopCount((w & (~w + 1)) - 1); // count the zeros below the lowest 1
+#endif
+  }
+
+  BitVector::WordType * BitVector::NewArray (size_t numwords)
   {
-    // return mask for index % 8
-    // the low order 3 bits is the remainder when dividing by 8
-    size_t shiftamount = index & (size_t)0x07;  // low order 3 bits
-    return (unsigned char)0x01 << shiftamount;
+    WordType * array = new(std::nothrow) WordType [numwords];
+    if (array == 0)
+    {
+      std::cerr << "** BitVector error: memory allocation failure -- terminating program.\n";
+      exit (EXIT_FAILURE);
+    }
+    return array;
+  }
+
+  void BitVector::CheckSize (const BitVector& bv) const
+  {
+    if (wordArraySize_ != bv.wordArraySize_)
+    {
+      std::cerr << "** BitVector error: bulk operation on vectors of unequal size\n";
+      exit (EXIT_FAILURE);
+    }
   }
 
 } // namespace fsu
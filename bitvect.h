@@ -0,0 +1,120 @@
+/*
+    bitvect.h
+    11/11/11
+    Chris Lacher
+
+    BitVector class - array of 64-bit words version
+
+    A BitVector is a fixed-size sequence of bits indexed 0 .. Size()-1.
+    Bits are stored in an array of 64-bit words, so whole-vector operations
+    (Set(), Unset(), Flip(), Count(), And(), Or(), Xor()) process 64 bits
+    per loop iteration. These loops are straight-line over contiguous
+    words and are vectorized by the compiler at -O2 and above.
+
+    Size() is numbits rounded up to a multiple of 64 (minimum 64).
+
+    FindFirst() and FindNext(i) return Size() when there is no set bit,
+    so the idiom for visiting every set bit is:
+
+      for (size_t i = b.FindFirst(); i < b.Size(); i = b.FindNext(i)) { ... }
+
+    Rank1(i) and Select1(k) are answered from a two-level directory that is
+    built on the first call after a mutation and discarded by any mutator:
+    level 1 holds the running count at each 512-bit superblock, level 2 the
+    count within the superblock at each word. Rank1 is two table reads and
+    one popcount; Select1 uses a sampled position of every 512th 1 bit to
+    narrow the superblock search before scanning at most 8 words.
+    The directory costs about 3/8 bit per bit of the vector.
+
+    Building the directory writes to the vector, const or not. Rank1 and
+    Select1 may run on several threads at once only after the directory
+    exists: call BuildIndex() after the last mutation and before sharing
+    the vector. Without it, the first Rank1 or Select1 call must not
+    overlap any other use of the vector.
+
+    Copyright 2011, R.C. Lacher
+*/
+
+#ifndef _BITVECT_H
+#define _BITVECT_H
+
+#include <iostream>
+#include <cstdlib>   // EXIT_FAILURE, size_t
+#include <stdint.h>  // uint64_t
+
+namespace fsu
+{
+
+  class BitVector;
+
+  std::ostream& operator << (std::ostream& os, const BitVector& bv);
+
+  //----------------------------------
+  //     BitVector
+  //----------------------------------
+
+  class BitVector
+  {
+  public:
+    typedef uint64_t WordType;
+    enum { wordBits = 64 };
+
+    explicit   BitVector  (size_t numbits = 64); // constructor, all bits = 0
+               BitVector  (const BitVector&);    // copy constructor
+               ~BitVector ();                    // destructor
+    BitVector& operator = (const BitVector& a);  // assignment operator
+
+    size_t     Size       () const;          // return size of bitvector
+
+    // single bit and whole vector mutators
+    void       Set        ();                // make all bits = 1
+    void       Set        (size_t index);    // make bit = 1
+    void       Unset      ();                // make all bits = 0
+    void       Unset      (size_t index);    // make bit = 0
+    void       Flip       ();                // change all bits
+    void       Flip       (size_t index);    // change bit
+    bool       Test       (size_t index) const; // return bit value
+
+    // population count and scanning
+    size_t     Count      () const;             // number of bits = 1
+    size_t     FindFirst  () const;             // index of first 1 bit, or Size()
+    size_t     FindNext   (size_t index) const; // index of first 1 bit after index, or Size()
+
+    // succinct index support
+    size_t     Rank1      (size_t index) const; // number of 1 bits in [0, index)
+    size_t     Select1    (size_t k) const;     // index of 1 bit with Rank1 = k, or Size()
+    void       BuildIndex () const;              // build the directory now, if missing
+
+    // bulk (word-parallel) operations; operand sizes must agree
+    BitVector& And        (const BitVector& bv); // this = this & bv
+    BitVector& Or         (const BitVector& bv); // this = this | bv
+    BitVector& Xor        (const BitVector& bv); // this = this ^ bv
+
+    void       Dump       (std::ostream& os) const;
+
+  private:
+    // data
+    WordType * wordArray_;
+    size_t     wordArraySize_;
+
+    // rank/select directory - built on demand, invalidated by mutators
+    mutable size_t   * superCount_;   // 1 bits before each superblock, plus total
+    mutable uint16_t * wordCount_;    // 1 bits before each word within its superblock
+    mutable size_t   * selectSample_; // superblock holding 1 bit number j * 512
+    mutable size_t     numSamples_;
+
+    // methods
+    size_t          WordNumber  (size_t index) const;
+    static WordType Mask        (size_t index);
+    static size_t   PopCount    (WordType w);
+    static size_t   LowBit      (WordType w); // index of lowest 1 bit, w != 0
+    static WordType * NewArray  (size_t numwords);
+    void            CheckSize   (const BitVector& bv) const;
+    void            MakeIndex   () const;
+    void            ClearIndex  () const;
+    static size_t   SelectInWord (WordType w, size_t k); // index of k-th 1 bit in w
+  } ;
+
+} // namespace fsu
+
+#endif
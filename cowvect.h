@@ -0,0 +1,216 @@
+/*
+    cowvect.h
+
+    CowVector<T> - fixed-size vector with copy-on-write chunks
+
+    Elements are stored in chunks of chunkSize (4096) elements, each chunk
+    with a reference count. Copying a CowVector copies the chunk pointers
+    and increments the counts, so a copy costs Size() / chunkSize steps no
+    matter how much the elements own. Reads through the const operator[]
+    go straight to a shared chunk; the non-const operator[] first gives
+    this vector a private copy of the element's chunk if the chunk is
+    shared. A chunk that neither vector modifies stays shared for as long
+    as both exist. ReleaseShared() gives up every shared chunk for a new
+    one of default-constructed elements, for a vector about to discard
+    those elements anyway; private chunks are left as they are.
+
+    Reference counts are atomic: copies may be read, modified and destroyed
+    on different threads. Making a copy must not overlap a modification of
+    the source. Element references and iterators into elements are
+    invalidated, for the source vector, by the first modification of their
+    chunk after a copy (the old chunk now belongs to the copy).
+*/
+
+#ifndef _COWVECT_H
+#define _COWVECT_H
+
+#include <cstdlib>
+#include <atomic>
+
+namespace fsu
+{
+
+  template < typename T >
+  class CowVector
+  {
+  public:
+    typedef T ValueType;
+    enum { chunkBits = 12, chunkSize = 1 << chunkBits };
+
+    explicit   CowVector  (size_t size = 0);   // size default-constructed elements
+               CowVector  (const CowVector& v); // shares v's chunks
+               ~CowVector ();
+    CowVector& operator = (const CowVector& v);
+
+    const T&   operator [] (size_t i) const;
+    T&         operator [] (size_t i);          // copies i's chunk first if it is shared
+
+    size_t     Size         () const;
+    void       SetSize      (size_t size);      // discards the contents
+    size_t     ReleaseShared ();                // default elements in place of shared chunks; returns chunks replaced
+    void       Swap         (CowVector& v);
+    bool       Shared       (size_t i) const;   // chunk of element i is shared with another vector
+    size_t     SharedChunks () const;
+
+  private:
+    struct Chunk
+    {
+      std::atomic<size_t> refs;
+      size_t              count;
+      T *                 items;
+      explicit Chunk (size_t n) : refs(1), count(n), items(new T [n]) {}
+      ~Chunk () { delete [] items; }
+    } ;
+
+    Chunk **   chunks_;
+    size_t     numChunks_;
+    size_t     size_;
+
+    void       Allocate  (size_t size);
+    void       Release   ();
+    Chunk *    Unshare   (Chunk* c);  // private copy of c; drops this vector's reference to c
+  } ;
+
+  template < typename T >
+  CowVector<T>::CowVector (size_t size)
+    : chunks_(0), numChunks_(0), size_(0)
+  {
+    Allocate(size);
+  }
+
+  template < typename T >
+  CowVector<T>::CowVector (const CowVector& v)
+    : chunks_(0), numChunks_(v.numChunks_), size_(v.size_)
+  {
+    if (numChunks_ > 0)
+      chunks_ = new Chunk* [numChunks_];
+    for (size_t c = 0; c < numChunks_; ++c)
+    {
+      chunks_[c] = v.chunks_[c];
+      chunks_[c]->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  template < typename T >
+  CowVector<T>::~CowVector ()
+  {
+    Release();
+  }
+
+  template < typename T >
+  CowVector<T>& CowVector<T>::operator = (const CowVector& v)
+  {
+    if (this != &v)
+    {
+      CowVector<T> copy(v);
+      Swap(copy);
+    }
+    return *this;
+  }
+
+  template < typename T >
+  const T& CowVector<T>::operator [] (size_t i) const
+  {
+    return chunks_[i >> chunkBits]->items[i & (chunkSize - 1)];
+  }
+
+  template < typename T >
+  T& CowVector<T>::operator [] (size_t i)
+  {
+    Chunk*& c = chunks_[i >> chunkBits];
+    if (c->refs.load(std::memory_order_acquire) != 1)
+      c = Unshare(c);
+    return c->items[i & (chunkSize - 1)];
+  }
+
+  template < typename T >
+  size_t CowVector<T>::Size () const
+  {
+    return size_;
+  }
+
+  template < typename T >
+  void CowVector<T>::SetSize (size_t size)
+  {
+    Release();
+    Allocate(size);
+  }
+
+  template < typename T >
+  size_t CowVector<T>::ReleaseShared ()
+  {
+    size_t replaced = 0;
+    for (size_t c = 0; c < numChunks_; ++c)
+    {
+      if (chunks_[c]->refs.load(std::memory_order_acquire) == 1)
+        continue;
+      Chunk * fresh = new Chunk(chunks_[c]->count);
+      // the other owners may have let go meanwhile; then the old chunk is ours to delete
+      if (chunks_[c]->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete chunks_[c];
+      chunks_[c] = fresh;
+      ++replaced;
+    }
+    return replaced;
+  }
+
+  template < typename T >
+  void CowVector<T>::Swap (CowVector& v)
+  {
+    Chunk ** chunks = chunks_;  chunks_ = v.chunks_;  v.chunks_ = chunks;
+    size_t n = numChunks_;      numChunks_ = v.numChunks_;  v.numChunks_ = n;
+    n = size_;                  size_ = v.size_;  v.size_ = n;
+  }
+
+  template < typename T >
+  bool CowVector<T>::Shared (size_t i) const
+  {
+    return chunks_[i >> chunkBits]->refs.load(std::memory_order_acquire) != 1;
+  }
+
+  template < typename T >
+  size_t CowVector<T>::SharedChunks () const
+  {
+    size_t shared = 0;
+    for (size_t c = 0; c < numChunks_; ++c)
+      if (chunks_[c]->refs.load(std::memory_order_acquire) != 1)
+        ++shared;
+    return shared;
+  }
+
+  template < typename T >
+  void CowVector<T>::Allocate (size_t size)
+  {
+    size_ = size;
+    numChunks_ = (size + chunkSize - 1) >> chunkBits;
+    chunks_ = (numChunks_ > 0) ? new Chunk* [numChunks_] : 0;
+    for (size_t c = 0; c < numChunks_; ++c)
+      chunks_[c] = new Chunk((c + 1 < numChunks_) ? (size_t)chunkSize : size - (c << chunkBits));
+  }
+
+  template < typename T >
+  void CowVector<T>::Release ()
+  {
+    for (size_t c = 0; c < numChunks_; ++c)
+      if (chunks_[c]->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete chunks_[c];
+    delete [] chunks_;
+    chunks_ = 0;
+    numChunks_ = size_ = 0;
+  }
+
+  template < typename T >
+  typename CowVector<T>::Chunk* CowVector<T>::Unshare (Chunk* c)
+  {
+    Chunk * copy = new Chunk(c->count);
+    for (size_t i = 0; i < c->count; ++i)
+      copy->items[i] = c->items[i];
+    // the other owners may have let go meanwhile; then c is ours to delete
+    if (c->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete c;
+    return copy;
+  }
+
+} // namespace fsu
+
+#endif
@@ -10,11 +10,12 @@
 
        K =      String
        D =      int
-       H =      HashClass<K>
+       H =      HashClass<K>, chosen at run time with --hash
 */
 
 #include <fstream>
 #include <cctype>
+#include <string>
 
 #include <xstring.h>
 #include <hashclasses.h>
@@ -22,6 +23,9 @@
 #include <bitvect.h>
 
 #include <hashtbl.h>
+#include <tblload.h>
+#include <frozen.h>
+#include <hashsel.h>
 #include <compare.h>
 
 // in lieu of makefile
@@ -29,46 +33,26 @@
 #include <primes.cpp>
 #include <bitvect.cpp>
 #include <hashfunctions.cpp>
+#include <mapfile.cpp>
 // */
 
 void DisplayMenu(std::ostream& os = std::cout);
 void DisplayPrompt(const char* kt, const char* dt, const char* ht);
 
-// the KISS hash function
+// hash function and prime flag are selected at run time (hashsel.h)
 typedef fsu::String                        KeyType;
 typedef int                                DataType;
-typedef hashclass::KISS < KeyType >        HashType;
 typedef fsu::Entry < KeyType, DataType >   EntryType;
 typedef fsu::LessThan < EntryType >        ComparisonType;
 const char* kT = "fsu::String";
 const char* dT = "int";
-const char* hT = "hashclass::KISS <>";
-const bool PRIME = 1;
-// */
 
-/* // the MM hash function
-typedef fsu::String                        KeyType;
-typedef int                                DataType;
-typedef hashclass::MM < KeyType >          HashType;
-typedef fsu::Entry < KeyType, DataType >   EntryType;
-typedef fsu::LessThan < EntryType >        ComparisonType;
-const char* kT = "fsu::String";
-const char* dT = "int";
-const char* hT = "hashclass::MM <>";
-const bool PRIME = 1;
-// */
-
-/* // the Simple hash function
-typedef fsu::String                        KeyType;
-typedef int                                DataType;
-typedef hashclass::Simple < KeyType >      HashType;
-typedef fsu::Entry < KeyType, DataType >   EntryType;
-typedef fsu::LessThan < EntryType >        ComparisonType;
-const char* kT = "fsu::String";
-const char* dT = "int";
-const char* hT = "hashclass::Simple <>";
-const bool PRIME = 0;
-// */
+// combiner for Upsert
+template < typename D >
+struct Add
+{
+  D operator () (const D& a, const D& b) const { return a + b; }
+} ;
 
 // const traversal
 template < typename K , typename D , class H >
@@ -98,18 +82,64 @@ int CorrectColumnWidth(const fsu::String& t, int cw)
   return cw;
 }
 
+// the interactive session, instantiated once per hash class by hashsel::Select
+class Session
+{
+public:
+  int         argc;
+  char**      argv;
+  bool        PRIME;
+  int         status;
+
+  template < class HashType >
+  void Run (const char* hashName);
+} ;
+
 int main(int argc, char* argv[])
+{
+  Session session;
+  hashsel::HashId hashId = hashsel::KISS;
+  int primeChoice = -1;  // -1 = default for the hash
+  int a = 1;
+  while (a + 1 < argc && argv[a][0] == '-' && argv[a][1] == '-')
+  {
+    fsu::String option(argv[a]);
+    bool ok = 1;
+    if (option == "--hash")
+      ok = hashsel::Parse(argv[a+1], hashId);
+    else if (option == "--prime")
+      primeChoice = atoi(argv[a+1]) != 0;
+    else
+      ok = 0;
+    if (!ok)
+    {
+      std::cout << "** usage: " << argv[0] << " [--hash KISS|MM|Simple] [--prime 0|1] [command file]\n";
+      return EXIT_FAILURE;
+    }
+    a += 2;
+  }
+  session.argc   = argc - (a - 1);
+  session.argv   = argv + (a - 1);
+  session.PRIME  = (primeChoice == -1) ? hashsel::DefaultPrime(hashId) : primeChoice;
+  session.status = EXIT_FAILURE;
+  hashsel::Select < KeyType > (hashId, session);
+  return session.status;
+}
+
+template < class HashType >
+void Session::Run (const char* hashName)
 {
   typedef fsu::HashTable < KeyType, DataType, HashType > HashTableType;
+  std::string hTname = std::string("hashclass::") + hashName + " <>";
+  const char* hT = hTname.c_str();
   HashTableType* tablePtr;
   size_t numbuckets;
 
   fsu::String filename;
-  std::ifstream in1;
   std::ofstream out1;
   KeyType  key;
   DataType data;
-  HashTableType::Iterator htableItr;
+  typename HashTableType::Iterator htableItr;
   char command;
   // int cw1 = 3, cw2 = 3;
   std::ifstream ifs;
@@ -122,15 +152,16 @@ int main(int argc, char* argv[])
     if (ifs.fail())
     {
       std::cout << "** Unable to open command file " << argv[1] << " try again\n";
-      return EXIT_FAILURE;
+      return;
     }
     inptr = &ifs;
   }
   std::cout << "  Enter approximate number of buckets (0 to quit): ";
   *inptr >> numbuckets;
   if (BATCH) std::cout << numbuckets << '\n';
+  status = 0;
   if (numbuckets == 0)
-    return 0;
+    return;
 
   // tablePtr = new HashTableType(numbuckets, PRIME); // 1-parameter constructor
   HashType hfo;
@@ -209,6 +240,14 @@ int main(int argc, char* argv[])
       // cw2 = CorrectColumnWidth(data,cw2);
       break;
         
+    case 'U': case 'u': // Upsert(key, data, Add)
+      *inptr >> key;
+      *inptr >> data;
+      if (BATCH) std::cout << ' ' << key << ' ' << data << '\n';
+      std::cout << key << ':' << tablePtr->Upsert(key, data, Add<DataType>())
+                << " after upsert\n";
+      break;
+
     case '-': case '2':
       *inptr >> key;
       if (BATCH) std::cout << ' ' << key << '\n';
@@ -228,21 +267,52 @@ int main(int argc, char* argv[])
       if (BATCH) std::cout << filename << '\n';;
       if (filename.Element(0) == '0')
         break;
-      in1.clear();
-      in1.open(filename.Cstr());
-      if (in1.fail())
-      {
-        std::cout << "  Unable to open file " << filename << '\n'
-                  << "  Load() aborted\n";
-        break;
-      }
-      while (!in1.eof())
       {
-        in1 >> key >> data;
-        tablePtr->Insert(key,data);
+        size_t count;
+        if (!fsu::LoadTable(filename.Cstr(), *tablePtr, count, 1)) // pre-size from a binary header
+        {
+          std::cout << "  Unable to open file " << filename << '\n'
+                    << "  Load() aborted\n";
+          break;
+        }
+        std::cout << "  load completed: " << count << " records\n";
       }
-      in1.close();
-      std::cout << "  load completed\n";
+      break;
+
+    case 'W': case 'w':
+      std::cout << "  Enter snapshot file name (0 to abort): ";
+      *inptr >> filename;
+      if (BATCH) std::cout << filename << '\n';
+      if (filename.Element(0) == '0')
+        break;
+      if (tablePtr->Save(filename.Cstr()))
+        std::cout << "  snapshot saved to file " << filename << '\n';
+      else
+        std::cout << "  Save() aborted\n";
+      break;
+
+    case 'B': case 'b':
+      std::cout << "  Enter snapshot file name (0 to abort): ";
+      *inptr >> filename;
+      if (BATCH) std::cout << filename << '\n';
+      if (filename.Element(0) == '0')
+        break;
+      if (tablePtr->Load(filename.Cstr()))
+        std::cout << "  snapshot loaded: " << tablePtr->Size() << " entries\n";
+      else
+        std::cout << "  Load() aborted\n";
+      break;
+
+    case 'Z': case 'z':
+      std::cout << "  Enter image file name (0 to abort): ";
+      *inptr >> filename;
+      if (BATCH) std::cout << filename << '\n';
+      if (filename.Element(0) == '0')
+        break;
+      if (fsu::FrozenHashTable < KeyType, DataType, HashType >::Freeze(*tablePtr, filename.Cstr()))
+        std::cout << "  frozen image written to file " << filename << '\n';
+      else
+        std::cout << "  Freeze() aborted\n";
       break;
 
     case 'F': case 'f':
@@ -404,8 +474,8 @@ int main(int argc, char* argv[])
   }
   while (command != 'q');
   delete tablePtr;
-  return 1;
-} // end main()
+  status = 1;
+} // end Session::Run()
 
 void DisplayMenu(std::ostream& os)
 {
@@ -413,11 +483,15 @@ void DisplayMenu(std::ostream& os)
      << " ---------                             -----\n"
      << " Load data from file  ...............  L filename\n"
      << " save data to File  .................  F filename\n"
+     << " x.Save(filename) snapshot  .........  W filename\n"
+     << " x.Load(filename) snapshot  .........  B filename\n"
+     << " Freeze(x, filename) image  .........  Z filename\n"
      << " x.Insert(key,data)  ................  + key data\n"
      << " x.Remove(key)  .....................  - key\n"
      << " x.Includes(key)  ...................  I key\n"
      << " x.Retrieve(key,&data)  .............  R key\n"
      << " x.Put(key,data)  ...................  P key data\n"
+     << " x.Upsert(key,data,+)  ..............  U key data\n"
      << " x.Get(key)  ........................  g key\n"
      << " x.Get(key) const  ..................  G key\n"
      << " x.Clear()  .........................  C\n"
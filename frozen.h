@@ -0,0 +1,373 @@
+/*
+    frozen.h
+
+    FrozenHashTable <K, D, H> - read-only view of a frozen HashTable image
+
+    FrozenHashTable<K,D,H>::Freeze(table, path) writes a populated
+    HashTable<K,D,H> to one position-independent file:
+
+      header    magic "FSUFRZ01", then u64 fields (little-endian):
+                numBuckets, numEntries, prime, ladder, offsetsPos, entriesPos,
+                heapPos, fileSize, entrySize, nameLength; then the hash class
+                identity (typeid name), padded to 8 bytes
+      offsets   numBuckets + 1 u64 entry numbers: bucket b holds entries
+                offsets[b] .. offsets[b+1]-1
+      entries   fixed-size records { hash, keyPos, keyLength, data }
+      heap      key bytes, referenced by keyPos relative to the heap
+
+    Every reference is an offset, never a pointer, so the image can be
+    mapped at any address. Open(path) maps the file (MappedFile, random
+    access hint) and checks the header, then, in one pass, that the bucket
+    offsets run from 0 to numEntries without decreasing and that every
+    entry's key lies inside the heap, so no lookup can read outside the
+    file. Includes and Retrieve then read straight from the mapping with no
+    deserialization. Processes on one host
+    that open the same image share one physical copy in the page cache.
+
+    A lookup hashes the key once, reads two offsets, and scans the bucket's
+    entries comparing the stored hash before touching the heap, so a
+    mismatched key costs one compare of a cache-resident word.
+
+    Keys are string-like (Cstr() and Size()) or trivially copyable; data
+    must be trivially copyable. Entries and offsets are in host byte order,
+    so an image is meant for the host (and build) that wrote it. Includes
+    returns bool rather than an Iterator: the view has no iteration.
+*/
+
+#ifndef _FROZEN_H
+#define _FROZEN_H
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <stdint.h>
+#include <hashtbl.h>
+#include <mapfile.h>
+#include <tblfmt.h>
+
+namespace fsu
+{
+
+  namespace frozen
+  {
+    static const char   magic []    = "FSUFRZ01";
+    static const size_t magicSize   = 8;
+    static const size_t headerSize  = 88;   // magic + 10 u64 fields
+    static const size_t flushBytes  = 1 << 20;
+
+    template < typename D >
+    struct Entry
+    {
+      uint64_t hash;
+      uint64_t keyPos;
+      uint64_t keyLength;
+      D        data;
+    } ;
+
+    // key bytes: string-like keys by their characters, others by their object representation
+    template < typename T >
+    auto KeyData (const T& t, int) -> decltype(t.Cstr(), t.Size(), (const char*)0)
+    {
+      return t.Cstr();
+    }
+
+    template < typename T >
+    const char* KeyData (const T& t, long)
+    {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "FrozenHashTable: key is neither string-like nor trivially copyable");
+      return reinterpret_cast<const char*>(&t);
+    }
+
+    template < typename T >
+    auto KeyLength (const T& t, int) -> decltype(t.Cstr(), t.Size(), size_t())
+    {
+      return t.Size();
+    }
+
+    template < typename T >
+    size_t KeyLength (const T& , long)
+    {
+      return sizeof(T);
+    }
+
+    inline size_t Align8 (size_t n)
+    {
+      return (n + 7) & ~(size_t)7;
+    }
+  } // namespace frozen
+
+  template <typename K, typename D, class H>
+  class FrozenHashTable
+  {
+  public:
+    typedef K                                KeyType;
+    typedef D                                DataType;
+    typedef H                                HashType;
+    typedef frozen::Entry<D>                 EntryType;
+
+    static_assert(std::is_trivially_copyable<D>::value, "FrozenHashTable: data must be trivially copyable");
+
+    // writes table to path; false on failure
+    static bool    Freeze        (const HashTable<K,D,H>& table, const char* path);
+
+                   FrozenHashTable ();
+    explicit       FrozenHashTable (HashType hashObject);
+
+    bool           Open          (const char* path); // false if path is not a valid image for H
+    void           Close         ();
+    bool           IsOpen        () const;
+
+    bool           Includes      (const K& k) const;
+    bool           Retrieve      (const K& k, D& d) const;
+    size_t         Size          () const;
+    size_t         NumBuckets    () const;
+
+  private:
+    fsu::MappedFile     file_;
+    HashType            hashObject_;
+    size_t              numBuckets_;
+    size_t              size_;
+    bool                prime_;
+    size_t              ladder_;
+    const uint64_t *    offsets_;
+    const EntryType *   entries_;
+    const char *        heap_;
+
+    const EntryType*    Find          (const K& k) const;  // entry with key k, or 0
+  } ;
+
+  template <typename K, typename D, class H>
+  bool FrozenHashTable<K,D,H>::Freeze (const HashTable<K,D,H>& table, const char* path)
+  {
+    typedef typename HashTable<K,D,H>::BucketType BucketType;
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    if (out.fail())
+    {
+      std::cerr << " ** FrozenHashTable::Freeze: unable to open " << path << '\n';
+      return 0;
+    }
+
+    // section layout from one pass over the buckets
+    const size_t nb = table.numBuckets_;
+    size_t numEntries = 0, heapSize = 0;
+    for (size_t i = 0; i < nb; ++i)
+      for (typename BucketType::ConstIterator j = table.bucketVector_[i].Begin(); j != table.bucketVector_[i].End(); ++j)
+      {
+	++numEntries;
+	heapSize += frozen::KeyLength((*j).key_, 0);
+      }
+    const char * name = typeid(H).name();
+    const size_t offsetsPos = frozen::Align8(frozen::headerSize + strlen(name));
+    const size_t entriesPos = offsetsPos + (nb + 1) * sizeof(uint64_t);
+    const size_t heapPos    = entriesPos + numEntries * sizeof(EntryType);
+    const size_t fileSize   = heapPos + heapSize;
+
+    std::string buf(offsetsPos, '\0');
+    memcpy(&buf[0], frozen::magic, frozen::magicSize);
+    const uint64_t fields [10] = { nb, numEntries, table.prime_, table.ladder_, offsetsPos,
+				   entriesPos, heapPos, fileSize, sizeof(EntryType), strlen(name) };
+    for (size_t f = 0; f < 10; ++f)
+      tblfmt::Put64(&buf[frozen::magicSize + 8 * f], fields[f]);
+    memcpy(&buf[frozen::headerSize], name, strlen(name));
+
+    // offsets
+    uint64_t offset = 0;
+    for (size_t i = 0; i <= nb; ++i)
+    {
+      buf.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+      if (i < nb)
+	offset += table.bucketVector_[i].Size();
+      if (buf.size() >= frozen::flushBytes)
+      {
+	out.write(buf.data(), buf.size());
+	buf.clear();
+      }
+    }
+
+    // entries, then the heap, in the same bucket order
+    EntryType e;
+    memset(&e, 0, sizeof(e)); // padding bytes are written too
+    e.keyPos = 0;
+    for (size_t i = 0; i < nb; ++i)
+    {
+      for (typename BucketType::ConstIterator j = table.bucketVector_[i].Begin(); j != table.bucketVector_[i].End(); ++j)
+      {
+	e.hash      = table.hashObject_((*j).key_);
+	e.keyLength = frozen::KeyLength((*j).key_, 0);
+	e.data      = (*j).data_;
+	buf.append(reinterpret_cast<const char*>(&e), sizeof(e));
+	e.keyPos   += e.keyLength;
+      }
+      if (buf.size() >= frozen::flushBytes)
+      {
+	out.write(buf.data(), buf.size());
+	buf.clear();
+      }
+    }
+    for (size_t i = 0; i < nb; ++i)
+    {
+      for (typename BucketType::ConstIterator j = table.bucketVector_[i].Begin(); j != table.bucketVector_[i].End(); ++j)
+	buf.append(frozen::KeyData((*j).key_, 0), frozen::KeyLength((*j).key_, 0));
+      if (buf.size() >= frozen::flushBytes)
+      {
+	out.write(buf.data(), buf.size());
+	buf.clear();
+      }
+    }
+    out.write(buf.data(), buf.size());
+    out.close();
+    if (out.fail())
+    {
+      std::cerr << " ** FrozenHashTable::Freeze: write to " << path << " failed\n";
+      return 0;
+    }
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  FrozenHashTable<K,D,H>::FrozenHashTable ()
+    : file_(), hashObject_(), numBuckets_(0), size_(0), prime_(0), ladder_(0),
+      offsets_(0), entries_(0), heap_(0)
+  {}
+
+  template <typename K, typename D, class H>
+  FrozenHashTable<K,D,H>::FrozenHashTable (HashType hashObject)
+    : file_(), hashObject_(hashObject), numBuckets_(0), size_(0), prime_(0), ladder_(0),
+      offsets_(0), entries_(0), heap_(0)
+  {}
+
+  template <typename K, typename D, class H>
+  bool FrozenHashTable<K,D,H>::Open (const char* path)
+  {
+    Close();
+    if (!file_.Open(path, 0))
+    {
+      std::cerr << " ** FrozenHashTable::Open: unable to open " << path << '\n';
+      return 0;
+    }
+    const char * p    = file_.Data();
+    const size_t size = file_.Size();
+    const char * name = typeid(H).name();
+    if (size < frozen::headerSize || 0 != memcmp(p, frozen::magic, frozen::magicSize))
+    {
+      std::cerr << " ** FrozenHashTable::Open: " << path << " is not a frozen table image\n";
+      Close();
+      return 0;
+    }
+    uint64_t fields [10];
+    for (size_t f = 0; f < 10; ++f)
+      fields[f] = tblfmt::Get64(p + frozen::magicSize + 8 * f);
+    if (fields[9] != strlen(name) || size < frozen::headerSize + fields[9]
+	|| 0 != memcmp(p + frozen::headerSize, name, fields[9]))
+    {
+      std::cerr << " ** FrozenHashTable::Open: " << path << " was frozen with a different hash class\n";
+      Close();
+      return 0;
+    }
+    // counts are bounded by the file size first, so the products below cannot overflow
+    if (fields[8] != sizeof(EntryType) || fields[7] != size || fields[0] == 0
+	|| fields[0] >= size / sizeof(uint64_t) || fields[1] > size / sizeof(EntryType)
+	|| fields[4] < frozen::headerSize || fields[4] > size
+	|| fields[4] % 8 != 0 || fields[5] != fields[4] + (fields[0] + 1) * sizeof(uint64_t)
+	|| fields[6] != fields[5] + fields[1] * sizeof(EntryType) || fields[6] > size
+	|| (fields[2] && (fields[3] >= primeLadderSize || primeLadder[fields[3]] != fields[0])))
+    {
+      std::cerr << " ** FrozenHashTable::Open: " << path << " is damaged or was frozen by another build\n";
+      Close();
+      return 0;
+    }
+    // Find trusts the offsets and key extents: check them all once here
+    const uint64_t * offsets = reinterpret_cast<const uint64_t*>(p + fields[4]);
+    const EntryType * entries = reinterpret_cast<const EntryType*>(p + fields[5]);
+    const uint64_t heapSize = size - fields[6];
+    bool ok = (offsets[0] == 0 && offsets[fields[0]] == fields[1]);
+    for (uint64_t b = 0; ok && b < fields[0]; ++b)
+      ok = (offsets[b] <= offsets[b+1]);
+    for (uint64_t i = 0; ok && i < fields[1]; ++i)
+      ok = (entries[i].keyPos <= heapSize && entries[i].keyLength <= heapSize - entries[i].keyPos);
+    if (!ok)
+    {
+      std::cerr << " ** FrozenHashTable::Open: " << path << " has damaged offsets or entries\n";
+      Close();
+      return 0;
+    }
+    numBuckets_ = fields[0];
+    size_       = fields[1];
+    prime_      = fields[2] != 0;
+    ladder_     = fields[3];
+    offsets_    = offsets;
+    entries_    = entries;
+    heap_       = p + fields[6];
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  void FrozenHashTable<K,D,H>::Close ()
+  {
+    file_.Close();
+    numBuckets_ = size_ = ladder_ = 0;
+    prime_   = 0;
+    offsets_ = 0;
+    entries_ = 0;
+    heap_    = 0;
+  }
+
+  template <typename K, typename D, class H>
+  bool FrozenHashTable<K,D,H>::IsOpen () const
+  {
+    return file_.IsOpen();
+  }
+
+  template <typename K, typename D, class H>
+  const typename FrozenHashTable<K,D,H>::EntryType* FrozenHashTable<K,D,H>::Find (const K& k) const
+  {
+    if (numBuckets_ == 0)
+      return 0;
+    const size_t h = hashObject_(k);
+    const size_t b = prime_ ? fsu::PrimeLadderMod(h, ladder_) : h % numBuckets_;
+    const char * kd = frozen::KeyData(k, 0);
+    const size_t kl = frozen::KeyLength(k, 0);
+    for (uint64_t i = offsets_[b]; i < offsets_[b+1]; ++i)
+    {
+      const EntryType& e = entries_[i];
+      if (e.hash == h && e.keyLength == kl && 0 == memcmp(heap_ + e.keyPos, kd, kl))
+	return &e;
+    }
+    return 0;
+  }
+
+  template <typename K, typename D, class H>
+  bool FrozenHashTable<K,D,H>::Includes (const K& k) const
+  {
+    return Find(k) != 0;
+  }
+
+  template <typename K, typename D, class H>
+  bool FrozenHashTable<K,D,H>::Retrieve (const K& k, D& d) const
+  {
+    const EntryType * e = Find(k);
+    if (e == 0)
+      return 0;
+    d = e->data;
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  size_t FrozenHashTable<K,D,H>::Size () const
+  {
+    return size_;
+  }
+
+  template <typename K, typename D, class H>
+  size_t FrozenHashTable<K,D,H>::NumBuckets () const
+  {
+    return numBuckets_;
+  }
+
+} // namespace fsu
+
+#endif
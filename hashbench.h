@@ -0,0 +1,456 @@
+/*
+    hashbench.h
+
+    Benchmark support for HashTable-like tables
+
+    BenchTable<T> (pairs, numBuckets, hashObject, prime, config, results)
+    builds tables of type T from pairs (a Vector of Pair<K,D>) and times
+
+      bulk_insert  T::Insert(beg, end) of all pairs into an empty table
+      insert       T::Insert(k, d) of each pair into an empty table
+      find_hit     T::Retrieve(k, d) of each loaded key
+      find_miss    T::Retrieve(k, d) of each key with a '#' appended
+      traverse     one Begin() .. End() pass, per entry
+      par_traverse one ParallelReduce pass over every entry, per entry
+      remove       T::Remove(k) of each loaded key
+
+    With config.bloomBits > 0 every table gets a Bloom filter of that many
+    bits per key (HashTable::EnableBloom), sized for the pair count.
+
+    Each operation is run config.warmup times untimed, then config.trials
+    times timed. ns_per_op is total trial time over operation count, taken
+    from passes with no clock reads or sample stores inside the loop.
+    Latencies come from a separate pass per trial, which reads steady_clock
+    around every sampled call (each sample includes about 20 ns of clock
+    overhead) into a vector sized up front. At most config.maxSamples calls
+    per trial are sampled. find_hit and find_miss run only the sampled
+    calls. insert and remove depend on the table's state, so they repeat
+    the whole sequence on a fresh table and time the sampled calls only.
+    bulk_insert and traverse are only timed per trial, so their
+    percentiles are over trials.
+
+    BenchPerfect<T> (pairs, config, results) times the static alternative,
+    a PerfectHashTable (mphf.h): build, find_hit and find_miss, for side by
+    side comparison with the chained table's find rows.
+
+    BenchTaskPool (pool, n, config, results) measures scheduler overhead on
+    a TaskPool (taskpool.h) with empty tasks:
+
+      spawn_wait   n tasks spawned from the calling thread, then Wait: per task
+      fork_join    ParallelFor over n with grain 1 (recursive halving, so
+                   n - 1 spawns, most run by their spawner and some stolen): per leaf
+
+    WriteCSV / WriteJSON emit one record per operation, tagged with the
+    hash and prime labels so runs can be compared over time. WriteJSON
+    writes only the objects, so several runs can share one JSON array.
+*/
+
+#ifndef _HASHBENCH_H
+#define _HASHBENCH_H
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>   // std::sort
+#include <vector.h>
+#include <pair.h>
+#include <mphf.h>      // BenchPerfect
+#include <taskpool.h>  // BenchTaskPool
+
+namespace fsu
+{
+
+  struct BenchConfig
+  {
+    size_t  warmup;        // untimed runs per operation
+    size_t  trials;        // timed runs per operation
+    size_t  maxSamples;    // per-op latency samples kept per trial
+    size_t  bloomBits;     // Bloom filter bits per key in BenchTable's tables, 0 = none
+
+    BenchConfig () : warmup(1), trials(5), maxSamples(1000000), bloomBits(0) {}
+  } ;
+
+  struct BenchResult
+  {
+    const char * operation;
+    size_t       ops;         // operations per trial
+    double       nsPerOp;     // mean over trials
+    double       p50;         // latency percentiles, ns
+    double       p99;
+    double       p999;
+  } ;
+
+  namespace hashbench
+  {
+    typedef std::chrono::steady_clock Clock;
+
+    inline double Ns (Clock::time_point a, Clock::time_point b)
+    {
+      return std::chrono::duration<double, std::nano>(b - a).count();
+    }
+
+    inline double Percentile (fsu::Vector<double>& v, double p)
+    // pre: v sorted
+    {
+      if (v.Size() == 0)
+        return 0;
+      size_t i = (size_t)(p * (v.Size() - 1) + 0.5);
+      return v[i];
+    }
+
+    inline BenchResult Summarize (const char* operation, size_t ops, double totalNs, size_t trials,
+                                  fsu::Vector<double>& samples)
+    {
+      std::sort(samples.Begin(), samples.End());
+      BenchResult r;
+      r.operation = operation;
+      r.ops       = ops;
+      r.nsPerOp   = (ops > 0 && trials > 0) ? totalNs / (ops * trials) : 0;
+      r.p50       = Percentile(samples, 0.50);
+      r.p99       = Percentile(samples, 0.99);
+      r.p999      = Percentile(samples, 0.999);
+      return r;
+    }
+
+    // sample stride so that at most maxSamples latencies are kept per trial
+    inline size_t Stride (size_t ops, size_t maxSamples)
+    {
+      if (maxSamples == 0 || ops <= maxSamples)
+        return 1;
+      return (ops + maxSamples - 1) / maxSamples;
+    }
+
+    // each key with a '#' appended: keys not in the table
+    template < class P, typename K >
+    void MissKeys (const fsu::Vector<P>& pairs, fsu::Vector<K>& missKeys)
+    {
+      missKeys.SetSize(pairs.Size());
+      for (size_t i = 0; i < pairs.Size(); ++i)
+      {
+        std::ostringstream oss;
+        oss << pairs[i].first_ << '#';
+        missKeys[i] = K(oss.str().c_str());
+      }
+    }
+
+    // find_hit and find_miss against a loaded table
+    template < class T, class P, typename K >
+    void TimeLookups (const T& table, const fsu::Vector<P>& pairs, const fsu::Vector<K>& missKeys,
+                      const BenchConfig& config, fsu::Vector<BenchResult>& results)
+    {
+      const size_t n      = pairs.Size();
+      const size_t stride = Stride(n, config.maxSamples);
+      const size_t runs   = config.warmup + config.trials;
+      typename T::DataType d;
+      for (int miss = 0; miss < 2; ++miss)
+      {
+        fsu::Vector<double> samples;
+        samples.SetCapacity(config.trials * ((n + stride - 1) / stride));
+        double total = 0;
+        size_t found = 0;
+        for (size_t r = 0; r < runs; ++r)
+        {
+          // throughput: nothing but the lookups inside the clock window
+          Clock::time_point a = Clock::now();
+          if (miss)
+            for (size_t i = 0; i < n; ++i)
+              found += table.Retrieve(missKeys[i], d);
+          else
+            for (size_t i = 0; i < n; ++i)
+              found += table.Retrieve(pairs[i].first_, d);
+          if (r < config.warmup)
+            continue;
+          total += Ns(a, Clock::now());
+
+          // latency: the sampled lookups, each in its own window
+          for (size_t i = 0; i < n; i += stride)
+          {
+            const K& k = miss ? missKeys[i] : pairs[i].first_;
+            Clock::time_point s = Clock::now();
+            found += table.Retrieve(k, d);
+            samples.PushBack(Ns(s, Clock::now()));
+          }
+        }
+        volatile size_t keep = found; // keep the lookups observable
+        (void)keep;
+        results.PushBack(Summarize(miss ? "find_miss" : "find_hit", n, total, config.trials, samples));
+      }
+    }
+  } // namespace hashbench
+
+  template < class T, class P, class H >
+  void BenchTable (const fsu::Vector<P>& pairs, size_t numBuckets, const H& hashObject, bool prime,
+                   const BenchConfig& config, fsu::Vector<BenchResult>& results)
+  {
+    typedef hashbench::Clock Clock;
+    typedef typename T::KeyType  K;
+    const size_t n      = pairs.Size();
+    const size_t stride = hashbench::Stride(n, config.maxSamples);
+    const size_t runs   = config.warmup + config.trials;
+    results.Clear();
+
+    fsu::Vector < K > missKeys;   // keys not in the table
+    hashbench::MissKeys(pairs, missKeys);
+
+    // bulk_insert
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        T table(numBuckets, hashObject, prime);
+        if (config.bloomBits) table.EnableBloom(n, config.bloomBits);
+        Clock::time_point a = Clock::now();
+        table.Insert(pairs.Begin(), pairs.End());
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(n ? hashbench::Ns(a, b) / n : 0);
+        }
+      }
+      results.PushBack(hashbench::Summarize("bulk_insert", n, total, config.trials, samples));
+    }
+
+    // insert: throughput pass, then a latency pass on a second fresh table
+    {
+      fsu::Vector<double> samples;
+      samples.SetCapacity(config.trials * ((n + stride - 1) / stride));
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        {
+          T table(numBuckets, hashObject, prime);
+          if (config.bloomBits) table.EnableBloom(n, config.bloomBits);
+          Clock::time_point a = Clock::now();
+          for (size_t i = 0; i < n; ++i)
+            table.Insert(pairs[i].first_, pairs[i].second_);
+          if (r >= config.warmup)
+            total += hashbench::Ns(a, Clock::now());
+        }
+        if (r < config.warmup)
+          continue;
+        T table(numBuckets, hashObject, prime);
+        if (config.bloomBits) table.EnableBloom(n, config.bloomBits);
+        for (size_t i = 0; i < n; ++i)
+        {
+          if (i % stride == 0)
+          {
+            Clock::time_point s = Clock::now();
+            table.Insert(pairs[i].first_, pairs[i].second_);
+            samples.PushBack(hashbench::Ns(s, Clock::now()));
+          }
+          else
+            table.Insert(pairs[i].first_, pairs[i].second_);
+        }
+      }
+      results.PushBack(hashbench::Summarize("insert", n, total, config.trials, samples));
+    }
+
+    // the remaining operations run against one loaded table
+    T table(numBuckets, hashObject, prime);
+    if (config.bloomBits) table.EnableBloom(n, config.bloomBits);
+    table.Insert(pairs.Begin(), pairs.End());
+
+    // find_hit and find_miss
+    hashbench::TimeLookups(table, pairs, missKeys, config, results);
+
+    // traverse
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      size_t entries = 0;
+      const typename T::EntryType * volatile last = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        entries = 0;
+        Clock::time_point a = Clock::now();
+        for (typename T::ConstIterator i = table.Begin(); i != table.End(); ++i)
+        {
+          last = &(*i);
+          ++entries;
+        }
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(entries ? hashbench::Ns(a, b) / entries : 0);
+        }
+      }
+      (void)last;
+      results.PushBack(hashbench::Summarize("traverse", entries, total, config.trials, samples));
+    }
+
+    // par_traverse: the same visit, split over bucket ranges on the shared task pool
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      size_t entries = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        Clock::time_point a = Clock::now();
+        entries = table.ParallelReduce([] (const typename T::EntryType&) { return (size_t)1; },
+                                       [] (size_t x, size_t y) { return x + y; }, (size_t)0);
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(entries ? hashbench::Ns(a, b) / entries : 0);
+        }
+      }
+      results.PushBack(hashbench::Summarize("par_traverse", entries, total, config.trials, samples));
+    }
+
+    // remove: each pass removes every key from a freshly loaded table;
+    // throughput pass, then a latency pass
+    {
+      fsu::Vector<double> samples;
+      samples.SetCapacity(config.trials * ((n + stride - 1) / stride));
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        {
+          T victim(numBuckets, hashObject, prime);
+          if (config.bloomBits) victim.EnableBloom(n, config.bloomBits);
+          victim.Insert(pairs.Begin(), pairs.End());
+          Clock::time_point a = Clock::now();
+          for (size_t i = 0; i < n; ++i)
+            victim.Remove(pairs[i].first_);
+          if (r >= config.warmup)
+            total += hashbench::Ns(a, Clock::now());
+        }
+        if (r < config.warmup)
+          continue;
+        T victim(numBuckets, hashObject, prime);
+        if (config.bloomBits) victim.EnableBloom(n, config.bloomBits);
+        victim.Insert(pairs.Begin(), pairs.End());
+        for (size_t i = 0; i < n; ++i)
+        {
+          if (i % stride == 0)
+          {
+            Clock::time_point s = Clock::now();
+            victim.Remove(pairs[i].first_);
+            samples.PushBack(hashbench::Ns(s, Clock::now()));
+          }
+          else
+            victim.Remove(pairs[i].first_);
+        }
+      }
+      results.PushBack(hashbench::Summarize("remove", n, total, config.trials, samples));
+    }
+  }
+
+  template < class T, class P >
+  void BenchPerfect (const fsu::Vector<P>& pairs, const BenchConfig& config, fsu::Vector<BenchResult>& results)
+  // T is PerfectHashTable<K,D>: build (from a loaded chained table), find_hit, find_miss
+  {
+    typedef hashbench::Clock Clock;
+    typedef typename T::KeyType  K;
+    typedef fsu::HashTable < K, typename T::DataType, mphf::KeyHash<K> > SourceType;
+    const size_t n    = pairs.Size();
+    const size_t runs = config.warmup + config.trials;
+    results.Clear();
+
+    fsu::Vector < K > missKeys;
+    hashbench::MissKeys(pairs, missKeys);
+    SourceType source(n, mphf::KeyHash<K>(), 0);
+    source.Insert(pairs.Begin(), pairs.End());
+
+    T table;
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        Clock::time_point a = Clock::now();
+        table.Build(source);
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(n ? hashbench::Ns(a, b) / n : 0);
+        }
+      }
+      results.PushBack(hashbench::Summarize("build", n, total, config.trials, samples));
+    }
+    hashbench::TimeLookups(table, pairs, missKeys, config, results);
+  }
+
+  inline void BenchTaskPool (TaskPool& pool, size_t n, const BenchConfig& config, fsu::Vector<BenchResult>& results)
+  {
+    typedef hashbench::Clock Clock;
+    const size_t runs = config.warmup + config.trials;
+    results.Clear();
+    std::atomic<size_t> sink (0);
+
+    // spawn_wait
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        TaskGroup group;
+        Clock::time_point a = Clock::now();
+        for (size_t i = 0; i < n; ++i)
+          pool.Spawn(group, [&sink] () { sink.fetch_add(1, std::memory_order_relaxed); });
+        pool.Wait(group);
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(n ? hashbench::Ns(a, b) / n : 0);
+        }
+      }
+      results.PushBack(hashbench::Summarize("spawn_wait", n, total, config.trials, samples));
+    }
+
+    // fork_join
+    {
+      fsu::Vector<double> samples;
+      double total = 0;
+      for (size_t r = 0; r < runs; ++r)
+      {
+        Clock::time_point a = Clock::now();
+        pool.ParallelFor(0, n, 1, [&sink] (size_t, size_t) { sink.fetch_add(1, std::memory_order_relaxed); });
+        Clock::time_point b = Clock::now();
+        if (r >= config.warmup)
+        {
+          total += hashbench::Ns(a, b);
+          samples.PushBack(n ? hashbench::Ns(a, b) / n : 0);
+        }
+      }
+      results.PushBack(hashbench::Summarize("fork_join", n, total, config.trials, samples));
+    }
+  }
+
+  inline void WriteCSV (std::ostream& os, const char* hash, bool prime,
+                        const fsu::Vector<BenchResult>& results, bool header = 1)
+  {
+    if (header)
+      os << "hash,prime,operation,ops,ns_per_op,p50_ns,p99_ns,p999_ns\n";
+    for (size_t i = 0; i < results.Size(); ++i)
+      os << hash << ',' << prime << ',' << results[i].operation << ','
+         << results[i].ops << ',' << results[i].nsPerOp << ','
+         << results[i].p50 << ',' << results[i].p99 << ',' << results[i].p999 << '\n';
+  }
+
+  inline void WriteJSON (std::ostream& os, const char* hash, bool prime,
+                         const fsu::Vector<BenchResult>& results)
+  // writes comma-separated objects; the caller supplies the enclosing [ ]
+  {
+    for (size_t i = 0; i < results.Size(); ++i)
+    {
+      os << "  { \"hash\": \"" << hash << "\", \"prime\": " << (prime ? "true" : "false")
+         << ", \"operation\": \"" << results[i].operation << "\""
+         << ", \"ops\": " << results[i].ops
+         << ", \"ns_per_op\": " << results[i].nsPerOp
+         << ", \"p50_ns\": " << results[i].p50
+         << ", \"p99_ns\": " << results[i].p99
+         << ", \"p999_ns\": " << results[i].p999 << " }"
+         << (i + 1 < results.Size() ? ",\n" : "");
+    }
+  }
+
+} // namespace fsu
+
+#endif
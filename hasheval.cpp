@@ -10,7 +10,7 @@
 
        K =      String
        D =      int
-       H =      THash<K>
+       H =      THash<K>, chosen at run time with --hash
 */
 
 #include <fstream>
@@ -22,97 +22,304 @@
 #include <bitvect.h>
 
 #include <hashtbl.h>
+#include <tblload.h>
+#include <parload.h>
+#include <hashbench.h>
+#include <hashsel.h>
+#include <mphf.h>
 
 /* // in lieu of makefile
 #include <xstring.cpp>
 #include <hashfunctions.cpp>
 #include <primes.cpp>
 #include <bitvect.cpp>
+#include <mapfile.cpp>
 // */
 
-// KISS hash function
+// hash function and prime flag are selected at run time (hashsel.h)
 typedef fsu::String                         KeyType;
 typedef int                                 DataType;
-typedef hashclass::KISS < KeyType >         HashType;
 typedef fsu::Entry < KeyType, DataType >    EntryType;
-const bool prime = 1;
-// */
 
-/* // MM hash function
-typedef fsu::String                         KeyType;
-typedef int                                 DataType;
-typedef hashclass::MM < KeyType >           HashType;
-typedef fsu::Entry < KeyType, DataType >    EntryType;
-const bool prime = 1;
-// */
+// collects scanned records for the benchmark
+template < class P >
+class PairCollector
+{
+public:
+  PairCollector (fsu::Vector<P>& pairs) : pairs_(pairs) {}
+  void operator () (const char* k, size_t klen, long long d)
+  {
+    pairs_.PushBack(P(key_(k, klen), fsu::tblload::ToData < typename P::SecondType > (d)));
+  }
+private:
+  fsu::Vector<P>&                                  pairs_;
+  fsu::tblload::KeyMaker < typename P::FirstType > key_;
+} ;
 
-/* // Simple hash function
-typedef fsu::String                         KeyType;
-typedef int                                 DataType;
-typedef hashclass::Simple < KeyType >       HashType;
-typedef fsu::Entry < KeyType, DataType >    EntryType;
-const bool prime = 0;
-// */
+void Usage ()
+{
+  std::cout << " ** program requires 2 or 3 arguments\n"
+	    << "    1 = approx no of buckets (required)\n"
+	    << "    2 = input table filename, text or binary (required)\n"
+	    << "    3 = output analysis filename (optional)\n"
+	    << "    options (before the arguments):\n"
+	    << "    --hash h     = KISS, MM, Simple, or all (default KISS)\n"
+	    << "    --prime p    = 1 for prime bucket count, 0 for not, or all\n"
+	    << "                   (default 1 for KISS and MM, 0 for Simple)\n"
+	    << "    -r n = parallel load with n reader threads\n"
+	    << "    -i n = parallel load into n hash-partitioned tables, one inserter thread each\n"
+	    << "    --presize    = size a binary table file's tables from its record count\n"
+	    << "    --bench      = time insert, lookups, remove and traversal instead of Analysis\n"
+	    << "    --mphf       = with --bench, also time a minimal perfect hash table (once)\n"
+	    << "                   and compare memory with the chained table\n"
+	    << "    --pool       = with --bench, also time task spawn and steal on the shared task pool (once)\n"
+	    << "    --json       = benchmark output as JSON (default CSV)\n"
+	    << "    --bloom b    = with --bench, Bloom filter of b bits per key in front of the table\n"
+	    << "    --trials n   = timed benchmark runs per operation (default 5)\n"
+	    << "    --warmup n   = untimed benchmark runs per operation (default 1)\n"
+	    << " ** try again\n";
+  exit(0);
+}
+
+void OpenFailure (const char* filename)
+{
+  std::cout << " ** Unable to open file " << filename << '\n'
+	    << " ** program closing\n";
+  exit(0);
+}
+
+// one evaluation run, instantiated once per hash class by hashsel::Select
+class Evaluation
+{
+public:
+  size_t              numbuckets;
+  const char*         infile;
+  std::ostream*       os;
+  size_t              readers, inserters;
+  bool                bench, json;
+  bool                mphf;      // also benchmark PerfectHashTable
+  bool                pool;      // also benchmark TaskPool::Shared()
+  bool                presize;   // Reserve() from a binary file's record count
+  fsu::BenchConfig    config;
+  bool                prime;
+  bool                first;     // first run of this invocation: print headers
+
+  template < class HashType >
+  void Run (const char* hashName)
+  {
+    typedef fsu::HashTable < KeyType, DataType, HashType > HashTableType;
+    HashType hfo;
+    std::cout << "  HashTable < fsu::String , int , hashclass::" << hashName
+	      << " <> >, prime = " << prime << '\n' << std::flush;
+
+    if (bench)
+    {
+      // read all records once, then time each operation against them
+      typedef fsu::Pair < KeyType, DataType > PairType;
+      fsu::MappedFile file;
+      if (!file.Open(infile))
+	OpenFailure(infile);
+      fsu::Vector < PairType > pairs;
+      PairCollector < PairType > collector(pairs);
+      if (fsu::tblfmt::IsBinary(file.Data(), file.Size()))
+	pairs.SetCapacity(fsu::tblfmt::RecordCount(file.Data(), file.Size()));
+      fsu::tblload::ScanFile(file.Data(), file.Data() + file.Size(), collector);
+      file.Close();
+      std::cout << "  benchmark: " << pairs.Size() << " records, "
+		<< config.warmup << " warmup + " << config.trials << " trials\n" << std::flush;
+
+      fsu::Vector < fsu::BenchResult > results;
+      fsu::BenchTable < HashTableType > (pairs, numbuckets, hfo, prime, config, results);
+      if (json)
+	fsu::WriteJSON(*os, hashName, prime, results);
+      else
+	fsu::WriteCSV(*os, hashName, prime, results, first);
+
+      // structure bytes, not counting memory owned by the keys themselves
+      {
+	HashTableType table(numbuckets, hfo, prime);
+	table.Insert(pairs.Begin(), pairs.End());
+	size_t bytes = table.NumBuckets() * sizeof(typename HashTableType::BucketType)
+	  + table.Size() * (sizeof(EntryType) + 2 * sizeof(void*));  // list links
+	std::cout << "  chained memory:   " << bytes << " bytes, "
+		  << (double)bytes / table.Size() << " bytes/key\n";
+      }
+      if (mphf && first)
+      {
+	typedef fsu::PerfectHashTable < KeyType, DataType > PerfectType;
+	PerfectType perfect;
+	fsu::HashTable < KeyType, DataType, fsu::mphf::KeyHash<KeyType> > source(pairs.Size(), fsu::mphf::KeyHash<KeyType>(), 0);
+	source.Insert(pairs.Begin(), pairs.End());
+	perfect.Build(source);
+	std::cout << "  MPHF memory:      " << perfect.MemoryBytes() << " bytes, "
+		  << (double)perfect.MemoryBytes() / perfect.Size() << " bytes/key, index "
+		  << (double)perfect.IndexBits() / perfect.Size() << " bits/key in "
+		  << perfect.Levels() << " levels\n" << std::flush;
+	fsu::BenchPerfect < PerfectType > (pairs, config, results);
+	if (json)
+	{
+	  *os << ",\n";
+	  fsu::WriteJSON(*os, "MPHF", 0, results);
+	}
+	else
+	  fsu::WriteCSV(*os, "MPHF", 0, results, 0);
+      }
+      if (pool && first)
+      {
+	fsu::TaskPool& taskPool = fsu::TaskPool::Shared();
+	size_t steals = taskPool.Steals();
+	fsu::BenchTaskPool(taskPool, pairs.Size(), config, results);
+	std::cout << "  task pool:        " << taskPool.Concurrency() << " threads, "
+		  << taskPool.Steals() - steals << " steals\n" << std::flush;
+	if (json)
+	{
+	  *os << ",\n";
+	  fsu::WriteJSON(*os, "TaskPool", 0, results);
+	}
+	else
+	  fsu::WriteCSV(*os, "TaskPool", 0, results, 0);
+      }
+    }
+    else if (readers > 0 || inserters > 0)
+    {
+      // pipelined parallel load: readers parse, inserters own one partition each
+      if (readers == 0) readers = 1;
+      if (inserters == 0) inserters = 1;
+      fsu::Vector < HashTableType* > tables (inserters);
+      for (size_t i = 0; i < inserters; ++i)
+	tables[i] = new HashTableType(numbuckets / inserters, hfo, prime);
+
+      fsu::LoadStats stats;
+      if (!fsu::ParallelLoad(infile, &tables[0], inserters, readers, stats, presize))
+	OpenFailure(infile);
+      std::cout << "  load completed: " << stats.records << " records\n"
+		<< "  readers:          " << readers << '\n'
+		<< "  inserters:        " << inserters << '\n'
+		<< "  seconds:          " << stats.seconds << '\n'
+		<< "  rows/s:           " << stats.records / stats.seconds << '\n'
+		<< "  MB/s:             " << stats.bytes / stats.seconds / 1.0e6 << '\n'
+		<< "  reader busy:      " << 100.0 * stats.readBusy / stats.readTotal << "%\n"
+		<< "  inserter busy:    " << 100.0 * stats.insertBusy / stats.insertTotal << "%\n"
+		<< std::flush;
+
+      for (size_t i = 0; i < inserters; ++i)
+      {
+	*os << "\n" << hashName << " prime = " << prime << " partition " << i << '\n';
+	tables[i]->Analysis(*os);
+	delete tables[i];
+      }
+    }
+    else
+    {
+      HashTableType * tablePtr = new HashTableType(numbuckets, hfo, prime);
+      size_t count;
+      if (!fsu::LoadTable(infile, *tablePtr, count, presize))
+	OpenFailure(infile);
+      std::cout << "  load completed: " << count << " records\n" << std::flush;
+      if (!first)
+	*os << '\n';
+      *os << hashName << " prime = " << prime << '\n';
+      tablePtr->Analysis(*os);
+      delete tablePtr;
+    }
+    first = 0;
+  }
+} ;
 
 int main(int argc, char* argv[])
 {
-  typedef fsu::HashTable < KeyType, DataType, HashType > HashTableType;
-  std::ifstream ifs;
   std::ofstream ofs;
   int writetofile = 0;
-  if (argc != 3 && argc != 4)
-  {
-    std::cout << " ** program requires 2 or 3 arguments\n"
-	      << "    1 = approx no of buckets (required)\n"
-	      << "    2 = input table filename (required)\n"
-	      << "    3 = output analysis filename (optional)\n"
-	      << " ** try again\n";
-    exit(0);
-  }
+  Evaluation eval;
+  eval.readers = eval.inserters = 0;
+  eval.bench = eval.json = eval.presize = eval.mphf = eval.pool = 0;
+  eval.first = 1;
 
-  ifs.open(argv[2]);
-  if (ifs.fail())
+  // options
+  bool allHashes = 0;
+  hashsel::HashId hashId = hashsel::KISS;
+  int primeChoice = -1;  // -1 = default for the hash, 0, 1, 2 = both
+  int a = 1;
+  while (a < argc && argv[a][0] == '-' && argv[a][1] != '\0')
   {
-    std::cout << " ** Unable to open file " << argv[2] << '\n'
-	      << " ** program closing\n";
-    exit(0);
+    fsu::String option(argv[a]);
+    if (option == "--bench" || option == "--json" || option == "--presize" || option == "--mphf"
+	|| option == "--pool")
+    {
+      if (option == "--bench") eval.bench = 1;
+      else if (option == "--json") eval.json = 1;
+      else if (option == "--mphf") eval.mphf = 1;
+      else if (option == "--pool") eval.pool = 1;
+      else eval.presize = 1;
+      a += 1;
+      continue;
+    }
+    if (a + 1 >= argc)
+      Usage();
+    fsu::String value(argv[a+1]);
+    if (option == "--hash")
+    {
+      if (value == "all")
+	allHashes = 1;
+      else if (!hashsel::Parse(argv[a+1], hashId))
+	Usage();
+    }
+    else if (option == "--prime")
+      primeChoice = (value == "all") ? 2 : atoi(argv[a+1]) != 0;
+    else if (option == "--bloom")
+      eval.config.bloomBits = atoi(argv[a+1]);
+    else if (option == "--trials")
+      eval.config.trials = atoi(argv[a+1]);
+    else if (option == "--warmup")
+      eval.config.warmup = atoi(argv[a+1]);
+    else if (argv[a][1] == 'r')
+      eval.readers = atoi(argv[a+1]);
+    else if (argv[a][1] == 'i')
+      eval.inserters = atoi(argv[a+1]);
+    else
+      Usage();
+    a += 2;
   }
+  argc -= a - 1;
+  argv += a - 1;
+  if (argc != 3 && argc != 4)
+    Usage();
 
   if (argc == 4)
   {
     ofs.open(argv[3]);
     if (ofs.fail())
-    {
-      std::cout << " ** Unable to open file " << argv[3] << '\n'
-		<< " ** program closing\n";
-      exit(0);
-    }
+      OpenFailure(argv[3]);
     writetofile = 1;
   }
+  eval.os = writetofile ? (std::ostream*)&ofs : (std::ostream*)&std::cout;
+  eval.numbuckets = atoi(argv[1]);
+  eval.infile = argv[2];
 
-  size_t numbuckets = atoi(argv[1]);
-  HashType hfo;
-  HashTableType * tablePtr = new HashTableType(numbuckets, hfo, prime);
-
-  KeyType k;
-  DataType d;
-  while (!ifs.eof())
+  // run the selected cells of the hash x prime matrix
+  bool jsonArray = eval.bench && eval.json;
+  if (jsonArray) *eval.os << "[\n";
+  for (int h = 0; h < hashsel::numHashes; ++h)
   {
-    ifs >> k >> d;
-    tablePtr->Insert(k,d);
+    if (!allHashes && h != hashId)
+      continue;
+    for (int p = 0; p <= 1; ++p)
+    {
+      bool wanted = (primeChoice == 2) || (primeChoice == p)
+	|| (primeChoice == -1 && p == (int)hashsel::DefaultPrime((hashsel::HashId)h));
+      if (!wanted)
+	continue;
+      if (jsonArray && !eval.first) *eval.os << ",\n";
+      eval.prime = p;
+      hashsel::Select < KeyType > ((hashsel::HashId)h, eval);
+    }
   }
-  ifs.close();
-  std::cout << "  load completed\n" << std::flush;
+  if (jsonArray) *eval.os << "\n]\n";
 
   if (writetofile)
   {
-    tablePtr->Analysis(ofs);
     ofs.close();
-    std::cout << "  analysis written to " << argv[3] << '\n';
-  }
-  else
-  {
-    tablePtr->Analysis(std::cout);
+    std::cout << (eval.bench ? "  benchmark" : "  analysis") << " written to " << argv[3] << '\n';
   }
   return 0;
 }
@@ -0,0 +1,71 @@
+/*
+    hashsel.h
+
+    Run-time selection among compile-time hash table configurations
+
+    Every hash class is instantiated at compile time; Select() maps a name
+    from the command line to one of them and calls
+
+      runner.template Run < HashType > (name)
+
+    so the code inside Run is a fully static instantiation for that hash
+    class: no virtual calls or function pointers in the hot loops.
+    Adding a hash function (or table variant) means adding one HashId and
+    one case to Select().
+*/
+
+#ifndef _HASHSEL_H
+#define _HASHSEL_H
+
+#include <cstring>
+#include <hashclasses.h>
+
+namespace hashsel
+{
+
+  enum HashId { KISS, MM, Simple, numHashes };
+
+  inline const char* Name (HashId id)
+  {
+    switch (id)
+    {
+      case KISS:   return "KISS";
+      case MM:     return "MM";
+      case Simple: return "Simple";
+      default:     return "?";
+    }
+  }
+
+  // true and id set iff name is one of the names above (case sensitive)
+  inline bool Parse (const char* name, HashId& id)
+  {
+    for (int i = 0; i < numHashes; ++i)
+      if (0 == strcmp(name, Name((HashId)i)))
+      {
+        id = (HashId)i;
+        return 1;
+      }
+    return 0;
+  }
+
+  // the prime flag each hash was configured with before run-time selection
+  inline bool DefaultPrime (HashId id)
+  {
+    return id != Simple;
+  }
+
+  template < typename K, class R >
+  void Select (HashId id, R& runner)
+  {
+    switch (id)
+    {
+      case KISS:   runner.template Run < hashclass::KISS < K > >   (Name(id)); break;
+      case MM:     runner.template Run < hashclass::MM < K > >     (Name(id)); break;
+      case Simple: runner.template Run < hashclass::Simple < K > > (Name(id)); break;
+      default:     break;
+    }
+  }
+
+} // namespace hashsel
+
+#endif
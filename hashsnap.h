@@ -0,0 +1,165 @@
+/*
+    hashsnap.h
+
+    Binary snapshot encoding used by HashTable::Save and HashTable::Load
+
+    A snapshot is
+
+      magic "FSUHSH01"
+      u64   number of buckets
+      u64   number of entries
+      u32   prime flag
+      u32   n, then n bytes: hash identity (typeid name of the hash class)
+      then, for each bucket in order:
+      u32   bucket size
+            per entry: u64 hash value, key, data
+
+    Header integers are little-endian (tblfmt.h). Keys and data are encoded
+    by Put / Reader::Get:
+
+      string-like types (having Cstr() and Size()): u32 length + characters,
+                                                    restored through T(const char*)
+      all other types:                              raw bytes, host order;
+                                                    must be trivially copyable
+
+    so a snapshot is portable between builds of the same program on hosts of
+    the same byte order, which is what a restart needs.
+*/
+
+#ifndef _HASHSNAP_H
+#define _HASHSNAP_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <stdint.h>
+#include <vector.h>
+#include <tblfmt.h>
+
+namespace fsu
+{
+
+  namespace hashsnap
+  {
+    static const char   magic []    = "FSUHSH01";
+    static const size_t magicSize   = 8;
+    static const size_t flushBytes  = 1 << 20;  // Save writes in chunks of about 1 MB
+
+    inline void Put32 (std::string& buf, uint32_t v)
+    {
+      char b [4];
+      tblfmt::Put32(b, v);
+      buf.append(b, 4);
+    }
+
+    inline void Put64 (std::string& buf, uint64_t v)
+    {
+      char b [8];
+      tblfmt::Put64(b, v);
+      buf.append(b, 8);
+    }
+
+    // string-like
+    template < typename T >
+    auto Put (std::string& buf, const T& t, int) -> decltype(t.Cstr(), t.Size(), void())
+    {
+      Put32(buf, (uint32_t)t.Size());
+      buf.append(t.Cstr(), t.Size());
+    }
+
+    // everything else
+    template < typename T >
+    void Put (std::string& buf, const T& t, long)
+    {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "hashsnap: type is neither string-like nor trivially copyable");
+      buf.append(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+
+    template < typename T >
+    void Put (std::string& buf, const T& t)
+    {
+      Put(buf, t, 0);
+    }
+
+    // Reader decodes from [p, e); after the first short read every Get fails
+    class Reader
+    {
+    public:
+      Reader (const char* p, const char* e) : p_(p), e_(e), ok_(1), buffer_(64) {}
+
+      bool Ok () const { return ok_; }
+
+      size_t Remaining () const { return ok_ ? (size_t)(e_ - p_) : 0; }
+
+      bool Bytes (size_t n)
+      {
+        if (ok_ && (size_t)(e_ - p_) < n)
+          ok_ = 0;
+        return ok_;
+      }
+
+      uint32_t Get32 ()
+      {
+        if (!Bytes(4)) return 0;
+        uint32_t v = tblfmt::Get32(p_);
+        p_ += 4;
+        return v;
+      }
+
+      uint64_t Get64 ()
+      {
+        if (!Bytes(8)) return 0;
+        uint64_t v = tblfmt::Get64(p_);
+        p_ += 8;
+        return v;
+      }
+
+      // compares the next n bytes with s and skips them
+      bool Match (const char* s, size_t n)
+      {
+        if (!Bytes(n)) return 0;
+        bool match = (0 == memcmp(p_, s, n));
+        p_ += n;
+        return match;
+      }
+
+      template < typename T >
+      auto Get (T& t, int) -> decltype(t.Cstr(), t.Size(), void())
+      {
+        size_t n = Get32();
+        if (!Bytes(n)) return;
+        if (buffer_.Size() < n + 1)
+          buffer_.SetSize(2 * n + 1);
+        memcpy(&buffer_[0], p_, n);
+        buffer_[n] = '\0';
+        p_ += n;
+        t = T(&buffer_[0]);
+      }
+
+      template < typename T >
+      void Get (T& t, long)
+      {
+        if (!Bytes(sizeof(T))) return;
+        memcpy(reinterpret_cast<char*>(&t), p_, sizeof(T));
+        p_ += sizeof(T);
+      }
+
+      template < typename T >
+      void Get (T& t)
+      {
+        Get(t, 0);
+      }
+
+    private:
+      const char *         p_;
+      const char *         e_;
+      bool                 ok_;
+      fsu::Vector < char > buffer_;
+    } ;
+  } // namespace hashsnap
+
+} // namespace fsu
+
+#endif
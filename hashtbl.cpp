@@ -33,27 +33,41 @@ void HashTable<K,D,H>::Analysis (std::ostream& os) const
   size_t item = 0;
   size_t element = 0;
   float check = 0;
+  // bucket size histogram, one per bucket range (see ParallelReduce), over
+  // the non-empty buckets only; the empty ones are counted from item
+  size_t threads = 0;
+  size_t ranges = RangeCount(threads);
+  Vector < Vector<size_t> > counts(ranges);
+  ForRanges([this, &counts] (size_t r, size_t lo, size_t hi)
+	    {
+	      Vector <size_t>& count = counts[r];
+	      for(size_t b = FirstOccupied(lo); b < hi; b = occupied_.FindNext(b))
+		{
+		  size_t s = bucketVector_[b].Size();
+		  if(count.Size() <= s)
+		    {
+		      count.SetSize(s + 1, 0);
+		    }
+		  count[s]++;
+		}
+	    }, ranges, threads);
   Vector <int> bucket(1);
   bucket[0] = 0;
-  for(i = 0; i < numBuckets_; i++)
+  for(size_t r = 0; r < ranges; r++)
     {
-      if(bucket.Size()-1 < bucketVector_[i].Size())
+      for(size = 1; size < counts[r].Size(); size++)
 	{
-	  if(bucket.Size()+1 >= bucket.Capacity())
+	  if(bucket.Size() <= size)
 	    {
-	      bucket.SetCapacity(bucketVector_[i].Size()*2);
+	      bucket.SetSize(size + 1, 0);
 	    }
-	  bucket.SetSize(bucketVector_[i].Size()+ 1, 0);
-	}
-      size = bucketVector_[i].Size();
-      bucket[size]++;
-      element += size;
-      if(size > 0)
-	{
-	  item++;
+	  bucket[size] += counts[r][size];
+	  element += size * counts[r][size];
+	  item += counts[r][size];
 	}
     }
-  os << "\ntable size: " << element << "\nnumber of buckets: " << numBuckets_ << "\nnonempty buckets: " << item << "\nmax bucket size: " << MaxBucketSize() << "\nexpected search time: " << (float)(1 + (element * 1.0)/(numBuckets_ * 1.0)) << "\nactual search time: " << (float)(1 + (element * 1.0)/(item * 1.0)) << '\n';
+  bucket[0] = numBuckets_ - item;
+  os << "\ntable size: " << element << "\nnumber of buckets: " << numBuckets_ << "\nnonempty buckets: " << item << "\nmax bucket size: " << bucket.Size() - 1 << "\nexpected search time: " << (float)(1 + (element * 1.0)/(numBuckets_ * 1.0)) << "\nactual search time: " << (float)(1 + (element * 1.0)/(item * 1.0)) << '\n';
   os << "\nbucket size distributions\n-------------------------\nsize \tactual \ttheory (uniform random distribution) \n----\t------\t------\n";
   check = numBuckets_ * pow((numBuckets_*1.0 - 1)/ (numBuckets_*1.0), element);
   i = 0;
@@ -7,6 +7,7 @@
     
     Defining the classes HashTable <K, D, H>
                      and HashTable <K, D, H> :: Iterator
+                     and HashTable <K, D, H> :: ConstIterator
 
     K                    = KeyType
     D                    = DataType
@@ -20,6 +21,16 @@
 
     The return type of HashTable<K, D, H>::Iterator::operator* is
     ValueType&, which means that (*I).data_ has type DataType&.
+    ConstIterator::operator* returns const ValueType&. As with List,
+    Iterator is derived from ConstIterator, so an Iterator converts to a
+    ConstIterator and the two compare with == and !=. Entry keys are const
+    either way: only data_ can be changed through an Iterator.
+
+    Erase(i) removes the entry at i and returns an Iterator to the next
+    entry (or End()), so a traversal can remove as it goes:
+
+      for (i = t.Begin(); i != t.End(); )
+        if (expired(*i)) i = t.Erase(i); else ++i;
 
     The following are the List operations used in the implementation,
     where E is BucketType::ValueType:
@@ -32,6 +43,103 @@
     size_t      Size     ();                           // returns the number of elements
     C::Iterator Begin    ();                           // returns iterator to first element
     C::Iterator End      ();                           // returns iterator past the last element
+    void        Splice   (C::Iterator i, C& c);        // relinks all of c at i
+    C::Iterator Splice   (C::Iterator i, C& c, C::Iterator j); // relinks item j of c at i
+
+    Save(path) writes a binary snapshot (format in hashsnap.h): the bucket
+    count, the hash class identity, and the entries bucket by bucket with
+    their hash values. Load(path) restores it with one sequential read:
+    entries are appended straight to their saved buckets, with no hashing
+    and no duplicate search. Load(path, n) with n different from the saved
+    bucket count re-buckets by the saved hash values, still without
+    calling the hash object.
+
+    Load checks the header's bucket and entry counts against the image
+    size before it sizes anything. When it restores buckets as saved, it
+    also checks that each saved hash reduces to its bucket. It hashes only
+    the first entry's key, to catch a hash object whose state differs from
+    the one that saved the file. Later keys are trusted to carry the hash
+    values that object gave them: a damaged or mixed file whose hash values
+    still fit their buckets loads without an error.
+
+    EnableBloom(n, bitsPerKey) puts a blocked Bloom filter (a BitVector of
+    about n * bitsPerKey bits) in front of the buckets. Every insert sets
+    its key's bits; Includes, Retrieve, Remove and const Get test them
+    before building an Entry or touching bucketVector_, so most misses cost
+    the hash plus one 64-byte block of the filter. All bits of a key lie in
+    one 512-bit block; with 10 bits per key about 1% of misses get through.
+    Removal leaves its bits set (a stale bit only lets a miss through);
+    Rehash, Reserve and Load rebuild the filter from the current entries,
+    sized for the larger of n and Size().
+
+    occupied_ is a BitVector with bit b set iff bucket b is non-empty.
+    Every path that inserts into or removes from a bucket keeps it current,
+    so Begin(), operator++, Erase, Clear, Size and EraseIf go from one
+    non-empty bucket to the next with FindNext (a count-trailing-zeros per
+    64 buckets) instead of calling Empty() on every bucket.
+
+    End() is a sentinel: bucket number endBucket (all ones) and a default
+    bucket iterator, as is a default-constructed iterator. Iterators rest
+    only at an entry or at the sentinel, so operator== decides on bucketNum_
+    alone unless both are in the same bucket, and neither the loop test nor
+    operator* touches the table. begin() and end() (with iterator,
+    const_iterator and the standard iterator traits; category forward)
+    allow range-for and STL algorithms:
+
+      for (const auto& e : t) os << e.key_ << ':' << e.data_ << '\n';
+      std::count_if(t.begin(), t.end(), pred);
+
+    ParallelForEach(fn, threads) calls fn(entry) on every entry, and
+    ParallelReduce(map, reduce, identity, threads) folds reduce over map(entry).
+    Both cut bucketVector_ into contiguous bucket ranges, about 8 per thread
+    and at least parallelGrain buckets each, and run them as tasks on
+    TaskPool::Shared() (taskpool.h), whose work stealing moves ranges of
+    long buckets off a busy worker. Within a range, the occupancy bitmap
+    skips empty buckets. threads sets the number of ranges; 0 means the
+    pool's concurrency, and 1, a pool with no workers, or a table with
+    fewer than 2 * parallelGrain buckets runs serially. fn, map
+    and reduce run concurrently and must not modify the table structure
+    (ParallelForEach on a non-const table may change data_). reduce must be
+    associative. The per-range results are combined in bucket order, so
+    reduce need not be commutative.
+
+      size_t bytes = t.ParallelReduce([](const E& e) { return e.key_.Size(); },
+                                      std::plus<size_t>(), size_t(0));
+
+    Analysis uses the same ranges to build the bucket size histogram.
+
+    Buckets are stored in a CowVector (cowvect.h): reference-counted chunks
+    of 4096 buckets. Copying a table, and Snapshot(), copy chunk pointers,
+    the occupancy bitmap and the scalars, not the entries. The first change
+    to a bucket in a shared chunk gives the changed table a private copy of
+    that chunk, so a point-in-time copy costs memory in proportion to what
+    the source changes while the copy lives. Snapshot() leaves out the
+    Bloom filter (EnableBloom on the snapshot if lookups need it). Reads
+    through const tables and ConstIterators never copy a chunk. Remove and
+    EraseIf copy a shared chunk only when they actually remove from it.
+    Writing through an Iterator copies on first dereference, so a read-only
+    loop should run over a const reference to the table. A snapshot may be
+    read on another thread while the source keeps changing, but taking the
+    snapshot must not overlap a change to the source. Iterators into the
+    source are invalidated by Snapshot() and by copying the table.
+
+    Absorb(other) moves every entry of other into this table and leaves
+    other empty. Entries move by relinking their List nodes (List::Splice):
+    no allocation and no Entry copy. A key in both tables is resolved by
+    policy: absorbKeep discards other's entry, absorbOverwrite (the default,
+    as Insert) puts other's entry in place of this one's, and
+    Absorb(other, combiner) sets data = combiner(data, other's data), as
+    Upsert does. When both tables have the same bucket count, entries stay
+    in their bucket number without being hashed, and a bucket that is empty
+    here takes other's whole bucket in one splice. That assumes the two
+    hash objects hash alike, as they do for per-thread tables built from
+    one prototype. With a Bloom filter here, moved keys are hashed for it.
+    A bucket other still shares with a copy (see below) is copied, not
+    moved, and other gets an empty chunk in place of each shared one;
+    those are the only allocations. Merging per-thread partial aggregates:
+
+      for (size_t t = 1; t < partial.Size(); ++t)
+        partial[0].Absorb(partial[t], std::plus<size_t>());
 
     Notes: copy enabled
            need default numbuckets
@@ -46,12 +154,22 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>    // used by Analysis in hashtbl.cpp
+#include <fstream>
+#include <string>
+#include <typeinfo> // hash class identity in snapshots
+#include <iterator> // std::forward_iterator_tag
+#include <cstddef>  // std::ptrdiff_t
+#include <utility>  // std::declval
+#include <taskpool.h> // parallel traversal
 
 #include <entry.h>
 #include <vector.h>
+#include <cowvect.h>
 #include <list.h>
 #include <primes.h>
 #include <genalg.h> // Swap()
+#include <bitvect.h> // Bloom filter
+#include <hashsnap.h>
 
 namespace fsu
 {
@@ -59,9 +177,15 @@ namespace fsu
   template <typename K, typename D, class H>
   class HashTable;
 
+  template <typename K, typename D, class H>
+  class ConstHashTableIterator;
+
   template <typename K, typename D, class H>
   class HashTableIterator;
 
+  template <typename K, typename D, class H>
+  class FrozenHashTable;  // frozen.h
+
   //--------------------------------------------
   //     HashTable <K,D,H>
   //--------------------------------------------
@@ -69,7 +193,9 @@ namespace fsu
   template <typename K, typename D, class H>
   class HashTable
   {
+    friend class ConstHashTableIterator <K,D,H>;
     friend class HashTableIterator <K,D,H>;
+    friend class FrozenHashTable <K,D,H>;
   public:
     typedef K                                KeyType;
     typedef D                                DataType;
@@ -78,13 +204,47 @@ namespace fsu
     typedef H                                HashType;
     typedef typename BucketType::ValueType   ValueType;
     typedef HashTableIterator<K,D,H>         Iterator;
-    typedef HashTableIterator<K,D,H>         ConstIterator;
+    typedef ConstHashTableIterator<K,D,H>    ConstIterator;
+    typedef Iterator                         iterator;        // STL names
+    typedef ConstIterator                    const_iterator;
 
     // ADT Table
     Iterator       Insert        (const K& k, const D& d);
     bool           Remove        (const K& k);
     bool           Retrieve      (const K& k, D& d) const;
-    Iterator       Includes      (const K& k) const;
+    Iterator       Includes      (const K& k);
+    ConstIterator  Includes      (const K& k) const;
+    Iterator       Erase         (Iterator i);    // removes entry at i, returns next position
+
+    // removes every entry e with pred(e) true, in one sweep; returns number removed
+    template < class P >
+    size_t         EraseIf       (P pred);
+
+    // bulk insert of a range of Pair<K,D> - hashes in batches ahead of the bucket walks;
+    // a candidate only when *beg has a first_, so Insert(k, d) with converting types still works
+    template < class I, class = decltype((*std::declval<I&>()).first_) >
+    size_t         Insert        (I beg, I end);
+
+    // aggregation: one hash and one bucket walk, then data_ is changed in place
+    template < class F >
+    D&             Upsert        (const K& k, const D& delta, F combiner); // data = combiner(data, delta), or delta if new
+    template < class F >
+    D&             Update        (const K& k, F fn);                       // fn(data), data = D() if new
+
+    // merge: moves other's entries here by relinking nodes, leaves other empty;
+    // returns the number of keys new to this table
+    enum AbsorbPolicy { absorbKeep, absorbOverwrite };  // for a key in both tables
+    size_t         Absorb        (HashTable& other, AbsorbPolicy policy = absorbOverwrite);
+    template < class C >
+    size_t         Absorb        (HashTable& other, C combiner);           // data = combiner(data, other's data)
+
+    // parallel traversal over bucket ranges; threads = 0 uses hardware concurrency
+    template < class F >
+    void           ParallelForEach (F fn, size_t threads = 0);           // fn(Entry<K,D>&)
+    template < class F >
+    void           ParallelForEach (F fn, size_t threads = 0) const;     // fn(const Entry<K,D>&)
+    template < typename R, class M, class C >
+    R              ParallelReduce  (M map, C reduce, R identity, size_t threads = 0) const;
 
     // ADT Associative Array
     D&             Get           (const K& key);
@@ -97,22 +257,42 @@ namespace fsu
 
     void           Clear         ();
     void           Rehash        (size_t numBuckets = 0);
+    void           Reserve       (size_t numBuckets);  // Rehash iff fewer buckets
+
+    // binary snapshot; Load replaces the contents, false on any failure
+    bool           Save          (const char* path) const;
+    bool           Load          (const char* path, size_t numBuckets = 0);
     size_t         Size          () const;
+    size_t         NumBuckets    () const;
     bool           Empty         () const;
 
-    // Iterator       Begin         ();
-    // Iterator       End           ();
+    Iterator       Begin         ();
+    Iterator       End           ();
 
     ConstIterator  Begin         () const;
     ConstIterator  End           () const;
 
+    // range-for and STL algorithm support
+    Iterator       begin         ();
+    Iterator       end           ();
+    ConstIterator  begin         () const;
+    ConstIterator  end           () const;
+
     // first ctor uses default hash object, second uses supplied hash object
     explicit       HashTable     (size_t numBuckets = 100, bool prime = 1);
     HashTable                    (size_t numBuckets, HashType hashObject, bool prime = 1);
                    ~HashTable    ();
-    HashTable                    (const HashTable<K,D,H>&);
+    HashTable                    (const HashTable<K,D,H>&);  // shares buckets, copy on write
     HashTable& operator =        (const HashTable&);
 
+    // point-in-time copy sharing all buckets, without the Bloom filter
+    HashTable      Snapshot      () const;
+
+    // optional Bloom filter in front of the buckets, for miss-heavy workloads
+    void           EnableBloom   (size_t expectedEntries = 0, size_t bitsPerKey = 10);
+    void           DisableBloom  ();
+    bool           BloomEnabled  () const;
+
     // these are for debugging and analysis
     void           Dump          (std::ostream& os, int c1 = 0, int c2 = 0) const;
     size_t         MaxBucketSize () const;
@@ -121,22 +301,112 @@ namespace fsu
   private:
     // data
     size_t                 numBuckets_;
-    Vector < BucketType >  bucketVector_;
+    CowVector < BucketType > bucketVector_;  // chunks shared with copies until written
     HashType               hashObject_;
     bool                   prime_;     // flag for prime number of buckets
+    size_t                 ladder_;    // primeLadder index of numBuckets_, when prime_
+    BitVector              occupied_;  // bit b = 1 iff bucket b is non-empty
+    BitVector *            bloom_;     // Bloom filter, or 0
+    size_t                 bloomKeys_; // entries the filter was sized for
+    size_t                 bloomBits_; // bits per entry
 
     // private method calculates bucket index
     size_t  Index          (const KeyType& k) const;
+    size_t  Reduce         (size_t h) const;  // bucket index of hash value h
+
+    // Bloom filter on hash values
+    void    BloomAdd       (size_t h);
+    bool    BloomTest      (size_t h) const;   // false: no entry has hash h
+    void    BloomBuild     ();                 // size for max(bloomKeys_, Size()) and refill
+    static uint64_t BloomMix (uint64_t x);
+
+    // insert or overwrite in bucket bn, the common part of the Insert methods
+    typename BucketType::Iterator InsertAt (size_t bn, const K& k, const D& d);
+
+    // entry for k, inserted as (k,d) if absent; inserted reports which
+    typename BucketType::Iterator FindOrInsert (const K& k, const D& d, bool& inserted);
+
+    // Absorb: resolve(mine, theirs) decides a key in both tables, true keeps mine
+    template < class R >
+    size_t  AbsorbFrom     (HashTable& other, R resolve);
+    template < class R >
+    bool    AbsorbEntry    (size_t bn, BucketType& from, typename BucketType::Iterator& j, R& resolve);
+
+    // copy on write: private copy of bucket b, returning the position of j in it
+    typename BucketType::Iterator Unshare (size_t b, typename BucketType::ConstIterator j);
+
+    // parallel traversal: bucket range r is [RangeBegin(r), RangeBegin(r+1))
+    size_t  RangeCount     (size_t& threads) const;  // adjusts threads to the ranges available
+    size_t  RangeBegin     (size_t r, size_t ranges) const;
+    size_t  FirstOccupied  (size_t lo) const;        // first non-empty bucket >= lo, or >= numBuckets_
+    template < class W >
+    void    ForRanges      (W work, size_t ranges, size_t threads) const; // work(r, lo, hi) for every range
+
+    enum { insertBatch = 64 };  // keys hashed per batch by bulk Insert
+    enum { parallelGrain = 16384, rangesPerThread = 8 };  // buckets per range, at least
+    enum { bloomBlockBits = 512, bloomProbes = 7 };  // one cache line, 7 bits per key
   } ;
 
   //--------------------------------------------
   //     HashTableIterator <K,D,H>
   //--------------------------------------------
 
+  //--------------------------------------------
+  //     ConstHashTableIterator <K,D,H>
+  //--------------------------------------------
+
   // Note: This is a ConstIterator - cannot be used to modify table 
 
   template <typename K, typename D, class H>
-  class HashTableIterator
+  class ConstHashTableIterator
+  {
+    friend class HashTable <K,D,H>;
+  public:
+    typedef K                                KeyType;
+    typedef D                                DataType;
+    typedef fsu::Entry<K,D>                  EntryType;
+    typedef fsu::List<EntryType>             BucketType;
+    typedef H                                HashType;
+    typedef typename BucketType::ValueType   ValueType;
+    typedef HashTableIterator<K,D,H>         Iterator;
+    typedef ConstHashTableIterator<K,D,H>    ConstIterator;
+
+    // standard iterator traits
+    typedef std::forward_iterator_tag        iterator_category;
+    typedef Entry<K,D>                       value_type;
+    typedef std::ptrdiff_t                   difference_type;
+    typedef const Entry<K,D>*                pointer;
+    typedef const Entry<K,D>&                reference;
+
+    ConstHashTableIterator   ();
+    ConstHashTableIterator   (const ConstIterator& i);
+    bool Valid          () const;
+    ConstHashTableIterator <K,D,H>& operator =  (const ConstIterator& i);
+    ConstHashTableIterator <K,D,H>& operator ++ ();
+    ConstHashTableIterator <K,D,H>  operator ++ (int);
+    const Entry <K,D>&         operator *  () const;
+    const Entry <K,D>*         operator -> () const;
+    bool                       operator == (const ConstIterator& i2) const;
+    bool                       operator != (const ConstIterator& i2) const;
+
+  protected:
+    static const size_t endBucket = ~static_cast<size_t>(0); // bucketNum_ of End()
+    bool AtEnd          () const;  // End() sentinel or default constructed
+
+    const HashTable <K,D,H> *           tablePtr_;
+    size_t                              bucketNum_;
+    typename BucketType::ConstIterator  bucketItr_;
+  } ;
+
+  //--------------------------------------------
+  //     HashTableIterator <K,D,H>
+  //--------------------------------------------
+
+  // Iterator - only non-const HashTable methods create one, so the entry
+  // it refers to belongs to a modifiable table
+
+  template <typename K, typename D, class H>
+  class HashTableIterator : public ConstHashTableIterator <K,D,H>
   {
     friend class HashTable <K,D,H>;
   public:
@@ -147,23 +417,24 @@ namespace fsu
     typedef H                                HashType;
     typedef typename BucketType::ValueType   ValueType;
     typedef HashTableIterator<K,D,H>         Iterator;
-    typedef HashTableIterator<K,D,H>         ConstIterator;
+    typedef ConstHashTableIterator<K,D,H>    ConstIterator;
+
+    // standard iterator traits; data_ is writable through an Iterator
+    typedef Entry<K,D>*                      pointer;
+    typedef Entry<K,D>&                      reference;
 
     HashTableIterator   ();
     HashTableIterator   (const Iterator& i);
-    bool Valid          () const;
     HashTableIterator <K,D,H>& operator =  (const Iterator& i);
     HashTableIterator <K,D,H>& operator ++ ();
     HashTableIterator <K,D,H>  operator ++ (int);
-    // Entry <K,D>&               operator * ();
+    Entry <K,D>&               operator *  ();
     const Entry <K,D>&         operator *  () const;
-    bool                       operator == (const Iterator& i2) const;
-    bool                       operator != (const Iterator& i2) const;
+    Entry <K,D>*               operator -> ();
+    const Entry <K,D>*         operator -> () const;
 
   protected:
-    const HashTable <K,D,H> *           tablePtr_;
-    size_t                              bucketNum_;
-    typename BucketType::ConstIterator  bucketItr_;
+    explicit HashTableIterator (const ConstIterator& i); // used by HashTable to promote its own positions
   } ;
 
   //--------------------------------------------
@@ -175,56 +446,355 @@ namespace fsu
   template <typename K, typename D, class H>
   HashTableIterator<K,D,H> HashTable<K,D,H>::Insert (const K& k, const D& d)
   {
-    EntryType e(k,d);
+    size_t h = hashObject_(k);
+    if (bloom_) BloomAdd(h);
     Iterator i;
     i.tablePtr_  = this;
-    i.bucketNum_ = Index(k);
-    typename BucketType::Iterator j  = bucketVector_[i.bucketNum_].Includes(e);
+    i.bucketNum_ = Reduce(h);
+    i.bucketItr_ = InsertAt(i.bucketNum_, k, d);
+    return i;
+  }
 
-    // new version works for all List ADTs
-    if (j == bucketVector_[i.bucketNum_].End())
+  template <typename K, typename D, class H>
+  template <class I, class>
+  size_t HashTable<K,D,H>::Insert (I beg, I end)
+  {
+    // hash a batch of keys first, then do the bucket walks: the hash loop has
+    // no dependent loads, and each bucket is prefetched well before its walk
+    size_t index [insertBatch];
+    size_t count = 0;
+    while (beg != end)
     {
-      j = bucketVector_[i.bucketNum_].Insert(e);
+      I first = beg;
+      size_t n = 0;
+      for ( ; beg != end && n < insertBatch; ++beg, ++n)
+      {
+        size_t h = hashObject_((*beg).first_);
+        if (bloom_) BloomAdd(h);
+        index[n] = Reduce(h);
+#if defined(__GNUC__)
+        __builtin_prefetch(&bucketVector_[index[n]]);
+#endif
+      }
+      for (size_t j = 0; j < n; ++j, ++first)
+        InsertAt(index[j], (*first).first_, (*first).second_);
+      count += n;
     }
-    else
+    return count;
+  }
+
+  template <typename K, typename D, class H>
+  template <class F>
+  D& HashTable<K,D,H>::Upsert (const K& k, const D& delta, F combiner)
+  {
+    bool inserted;
+    typename BucketType::Iterator j = FindOrInsert(k, delta, inserted);
+    if (!inserted)
+      (*j).data_ = combiner((*j).data_, delta);
+    return (*j).data_;
+  }
+
+  template <typename K, typename D, class H>
+  template <class F>
+  D& HashTable<K,D,H>::Update (const K& k, F fn)
+  {
+    bool inserted;
+    typename BucketType::Iterator j = FindOrInsert(k, D(), inserted);
+    fn((*j).data_);
+    return (*j).data_;
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable<K,D,H>::Absorb (HashTable& other, AbsorbPolicy policy)
+  {
+    if (policy == absorbKeep)
+      return AbsorbFrom(other, [] (EntryType&, EntryType&) -> bool { return 1; });
+    return AbsorbFrom(other, [] (EntryType&, EntryType&) -> bool { return 0; });
+  }
+
+  template <typename K, typename D, class H>
+  template <class C>
+  size_t HashTable<K,D,H>::Absorb (HashTable& other, C combiner)
+  {
+    return AbsorbFrom(other, [&combiner] (EntryType& mine, EntryType& theirs) -> bool
+		      {
+			mine.data_ = combiner(mine.data_, theirs.data_);
+			return 1;
+		      });
+  }
+
+  template <typename K, typename D, class H>
+  template <class R>
+  size_t HashTable<K,D,H>::AbsorbFrom (HashTable& other, R resolve)
+  {
+    if (this == &other)
+      return 0;
+    // same bucket count (and so the same Reduce): an entry keeps its bucket number
+    bool aligned = (numBuckets_ == other.numBuckets_ && prime_ == other.prime_);
+    const CowVector<BucketType>& theirs = other.bucketVector_;
+    size_t count = 0;
+    BucketType copy;   // stand-in for a bucket other shares with a copy of other
+    for (size_t b = other.occupied_.FindFirst(); b < other.numBuckets_; b = other.occupied_.FindNext(b))
     {
-      *j = e;
+      // a copy of other still uses this chunk: move a copy of the bucket instead
+      BucketType * from;
+      if (other.bucketVector_.Shared(b))
+      {
+	copy = theirs[b];
+	from = &copy;
+      }
+      else
+	from = &other.bucketVector_[b];
+      typename BucketType::Iterator j = from->Begin();
+      if (aligned && !occupied_.Test(b))
+      {
+	if (bloom_)
+	  for ( ; j != from->End(); ++j)
+	    BloomAdd(hashObject_((*j).key_));
+	count += from->Size();
+	bucketVector_[b].Splice(bucketVector_[b].End(), *from);
+	occupied_.Set(b);
+	continue;
+      }
+      while (j != from->End())
+      {
+	size_t bn = b;
+	if (bloom_ || !aligned)
+	{
+	  size_t h = hashObject_((*j).key_);
+	  if (bloom_) BloomAdd(h);
+	  if (!aligned) bn = Reduce(h);
+	}
+	if (AbsorbEntry(bn, *from, j, resolve))
+	  ++count;
+      }
     }
-    i.bucketItr_ = j;
-    // */
+    other.Clear();   // drops what is left: discarded entries and shared chunks
+    return count;
+  }
 
-    /* // headless list version
-    i.bucketItr_ = j;
-    if (j.Valid() && e == *j)   // if found, overwrite entry data
-      *j = e;                   
-    else                          // not found, insert new entry
-      i.bucketItr_ = bucketVector_[i.bucketNum_].Insert(e);
-    // */
- 
-    return i;
+  template <typename K, typename D, class H>
+  template <class R>
+  bool HashTable<K,D,H>::AbsorbEntry (size_t bn, BucketType& from, typename BucketType::Iterator& j, R& resolve)
+  // moves the entry at j of from into bucket bn, or resolves it against an equal key;
+  // advances j; true iff the key was new here
+  {
+    BucketType& bucket = bucketVector_[bn];
+    for (typename BucketType::Iterator m = bucket.Begin(); m != bucket.End(); ++m)
+    {
+      if ((*m).key_ == (*j).key_)
+      {
+	if (resolve(*m, *j))
+	  j = from.Remove(j);
+	else
+	{
+	  j = bucket.Splice(m, from, j);   // theirs goes in ahead of mine
+	  bucket.Remove(m);
+	}
+	return 0;
+      }
+    }
+    j = bucket.Splice(bucket.End(), from, j);
+    occupied_.Set(bn);
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  typename HashTable<K,D,H>::BucketType::Iterator HashTable<K,D,H>::FindOrInsert (const K& k, const D& d, bool& inserted)
+  {
+    // compare keys in place: an Entry (and its key copy) is built only on insert
+    size_t h = hashObject_(k);
+    if (bloom_) BloomAdd(h);
+    size_t bn = Reduce(h);
+    BucketType& bucket = bucketVector_[bn];
+    for (typename BucketType::Iterator j = bucket.Begin(); j != bucket.End(); ++j)
+    {
+      if ((*j).key_ == k)
+      {
+	inserted = 0;
+	return j;
+      }
+    }
+    inserted = 1;
+    occupied_.Set(bn);
+    return bucket.Insert(EntryType(k,d));
   }
 
   template <typename K, typename D, class H>
   bool HashTable<K,D,H>::Remove (const K& k)
   {
+    size_t h = hashObject_(k);
+    if (bloom_ && !BloomTest(h))
+      return 0;
     EntryType e(k);
-    size_t bucketNum_ = Index(k);
+    size_t bucketNum_ = Reduce(h);
+    const CowVector<BucketType>& buckets = bucketVector_;
+    if (bucketVector_.Shared(bucketNum_) && buckets[bucketNum_].Includes(e) == buckets[bucketNum_].End())
+      return 0;   // miss: leave the chunk shared
     typename BucketType::Iterator j = bucketVector_[bucketNum_].Includes(e); 
     if (j != bucketVector_[bucketNum_].End())
     {
       if (*j == e)
       {
 	bucketVector_[bucketNum_].Remove(j);
+	if (bucketVector_[bucketNum_].Empty())
+	  occupied_.Unset(bucketNum_);
 	return 1;
       }
     }
     return 0;
   }
 
+  template <typename K, typename D, class H>
+  template <class P>
+  size_t HashTable<K,D,H>::EraseIf (P pred)
+  {
+    // List::Remove(i) unlinks the node at i and returns the next position,
+    // so each bucket is walked once with no re-hashing or re-searching
+    size_t count = 0;
+    const CowVector<BucketType>& buckets = bucketVector_;
+    for (size_t i = occupied_.FindFirst(); i < numBuckets_; i = occupied_.FindNext(i))
+    {
+      typename BucketType::Iterator j;
+      if (bucketVector_.Shared(i))
+      {
+	// copy the chunk only if this bucket has an entry to remove
+	typename BucketType::ConstIterator k = buckets[i].Begin();
+	while (k != buckets[i].End() && !pred(*k))
+	  ++k;
+	if (k == buckets[i].End())
+	  continue;
+	j = Unshare(i, k);   // before bucketVector_[i] below: that is now the private copy
+	j = bucketVector_[i].Remove(j);
+	++count;
+      }
+      else
+	j = bucketVector_[i].Begin();
+      BucketType& bucket = bucketVector_[i];
+      while (j != bucket.End())
+      {
+	if (pred(static_cast<const EntryType&>(*j)))
+	{
+	  j = bucket.Remove(j);
+	  ++count;
+	}
+	else
+	  ++j;
+      }
+      if (bucket.Empty())
+	occupied_.Unset(i);
+    }
+    return count;
+  }
+
+  template <typename K, typename D, class H>
+  template <class F>
+  void HashTable<K,D,H>::ParallelForEach (F fn, size_t threads)
+  {
+    size_t ranges = RangeCount(threads);
+    ForRanges([this, &fn] (size_t, size_t lo, size_t hi)
+	      {
+		for (size_t b = FirstOccupied(lo); b < hi; b = occupied_.FindNext(b))
+		{
+		  BucketType& bucket = bucketVector_[b];
+		  for (typename BucketType::Iterator j = bucket.Begin(); j != bucket.End(); ++j)
+		    fn(*j);
+		}
+	      }, ranges, threads);
+  }
+
+  template <typename K, typename D, class H>
+  template <class F>
+  void HashTable<K,D,H>::ParallelForEach (F fn, size_t threads) const
+  {
+    size_t ranges = RangeCount(threads);
+    ForRanges([this, &fn] (size_t, size_t lo, size_t hi)
+	      {
+		for (size_t b = FirstOccupied(lo); b < hi; b = occupied_.FindNext(b))
+		{
+		  const BucketType& bucket = bucketVector_[b];
+		  for (typename BucketType::ConstIterator j = bucket.Begin(); j != bucket.End(); ++j)
+		    fn(*j);
+		}
+	      }, ranges, threads);
+  }
+
+  template <typename K, typename D, class H>
+  template <typename R, class M, class C>
+  R HashTable<K,D,H>::ParallelReduce (M map, C reduce, R identity, size_t threads) const
+  {
+    size_t ranges = RangeCount(threads);
+    Vector < R > partial (ranges, identity);   // one result per range, no sharing
+    ForRanges([this, &map, &reduce, &partial] (size_t r, size_t lo, size_t hi)
+	      {
+		R acc = partial[r];
+		for (size_t b = FirstOccupied(lo); b < hi; b = occupied_.FindNext(b))
+		{
+		  const BucketType& bucket = bucketVector_[b];
+		  for (typename BucketType::ConstIterator j = bucket.Begin(); j != bucket.End(); ++j)
+		    acc = reduce(acc, map(*j));
+		}
+		partial[r] = acc;
+	      }, ranges, threads);
+    R result = identity;
+    for (size_t r = 0; r < ranges; ++r)
+      result = reduce(result, partial[r]);
+    return result;
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable<K,D,H>::RangeCount (size_t& threads) const
+  {
+    if (threads == 0)
+      threads = TaskPool::Shared().Concurrency();
+    size_t ranges = numBuckets_ / parallelGrain;
+    if (ranges > threads * rangesPerThread)
+      ranges = threads * rangesPerThread;
+    if (ranges < 2)
+      ranges = 1;
+    if (threads > ranges)
+      threads = ranges;
+    return ranges;
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable<K,D,H>::RangeBegin (size_t r, size_t ranges) const
+  {
+    // on a chunk boundary, so ranges never modify the same CowVector chunk
+    if (r >= ranges)
+      return numBuckets_;
+    size_t b = (numBuckets_ / ranges) * r + ((numBuckets_ % ranges) * r) / ranges;
+    return b - b % CowVector<BucketType>::chunkSize;
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable<K,D,H>::FirstOccupied (size_t lo) const
+  {
+    return (lo == 0) ? occupied_.FindFirst() : occupied_.FindNext(lo - 1);
+  }
+
+  template <typename K, typename D, class H>
+  template <class W>
+  void HashTable<K,D,H>::ForRanges (W work, size_t ranges, size_t threads) const
+  {
+    TaskPool& pool = TaskPool::Shared();
+    if (threads <= 1 || pool.Workers() == 0)
+    {
+      for (size_t r = 0; r < ranges; ++r)
+	work(r, RangeBegin(r, ranges), RangeBegin(r + 1, ranges));
+      return;
+    }
+    pool.ParallelFor(0, ranges, 1, [this, &work, ranges] (size_t lo, size_t hi)
+		     {
+		       for (size_t r = lo; r < hi; ++r)
+			 work(r, RangeBegin(r, ranges), RangeBegin(r + 1, ranges));
+		     });
+  }
+
   template <typename K, typename D, class H>
   bool HashTable<K,D,H>::Retrieve (const K& k, D& d) const
   {
-    Iterator i = Includes(k);
+    ConstIterator i = Includes(k);
     if (i != End())
     {
 	d = (*i).data_;
@@ -234,12 +804,46 @@ namespace fsu
   }
 
   template <typename K, typename D, class H>
-  HashTableIterator<K,D,H> HashTable<K,D,H>::Includes (const K& k) const
+  HashTableIterator<K,D,H> HashTable<K,D,H>::Includes (const K& k)
+  {
+    return Iterator(static_cast<const HashTable&>(*this).Includes(k));
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H> HashTable<K,D,H>::Erase (Iterator i)
+  {
+    if (!i.Valid() || i.tablePtr_ != this)
+    {
+      std::cerr << "** HashTable error: Erase() called with invalid iterator\n";
+      return End();
+    }
+    if (bucketVector_.Shared(i.bucketNum_))
+      i.bucketItr_ = Unshare(i.bucketNum_, i.bucketItr_);
+    i.bucketItr_ = bucketVector_[i.bucketNum_].Remove(i.bucketItr_);
+    if (i.bucketItr_ == bucketVector_[i.bucketNum_].End())
+    {
+      // last entry of its bucket: move on to the next non-empty bucket
+      if (bucketVector_[i.bucketNum_].Empty())
+	occupied_.Unset(i.bucketNum_);
+      i.bucketNum_ = occupied_.FindNext(i.bucketNum_);
+      if (i.bucketNum_ < numBuckets_)
+	i.bucketItr_ = bucketVector_[i.bucketNum_].Begin();
+      else
+	i = End();
+    }
+    return i;
+  }
+
+  template <typename K, typename D, class H>
+  ConstHashTableIterator<K,D,H> HashTable<K,D,H>::Includes (const K& k) const
   {
+    size_t h = hashObject_(k);
+    if (bloom_ && !BloomTest(h))
+      return End();
     EntryType e(k);
-    Iterator i;
+    ConstIterator i;
     i.tablePtr_ = this;
-    i.bucketNum_ = Index(e.key_);
+    i.bucketNum_ = Reduce(h);
     i.bucketItr_ = bucketVector_[i.bucketNum_].Includes(e); 
     if (i.bucketItr_ != bucketVector_[i.bucketNum_].End())
     {
@@ -258,10 +862,15 @@ namespace fsu
   {
     // 3: ultra streamlined version
     EntryType e(key);
-    size_t bn = Index(key);
+    size_t h = hashObject_(key);
+    if (bloom_) BloomAdd(h);   // may insert below
+    size_t bn = Reduce(h);
     typename BucketType::Iterator i = bucketVector_[bn].Includes(e); 
     if (i == bucketVector_[bn].End())
+    {
       i = bucketVector_[bn].Insert(e);
+      occupied_.Set(bn);
+    }
     return (*i).data_;
     // */
 
@@ -288,7 +897,7 @@ namespace fsu
   template <typename K, typename D, class H>
   const D& HashTable<K,D,H>::Get (const K& key) const
   {
-    Iterator i = Includes(key);
+    ConstIterator i = Includes(key);
     if (i == End())
     {
       std::cerr << "** Error: const bracket operator called on non-existence key\n";
@@ -322,37 +931,49 @@ namespace fsu
 
   template <typename K, typename D, class H>
   HashTable <K,D,H>::HashTable (size_t n, bool prime)
-    :  numBuckets_(n), bucketVector_(0), hashObject_(), prime_(prime)
+    :  numBuckets_(n), bucketVector_(0), hashObject_(), prime_(prime), ladder_(0),
+       bloom_(0), bloomKeys_(0), bloomBits_(0)
   {
     // ensure at least 2 buckets
     if (numBuckets_ < 3)
       numBuckets_ = 2;
-    // optionally convert to prime number of buckets
+    // optionally convert to prime number of buckets: next rung of the prime ladder
     if (prime_)
-      numBuckets_ = fsu::PrimeBelow(numBuckets_);
+    {
+      ladder_ = fsu::PrimeLadderIndex(numBuckets_);
+      numBuckets_ = fsu::primeLadder[ladder_];
+    }
     // create buckets
     bucketVector_.SetSize(numBuckets_);
+    occupied_ = BitVector(numBuckets_);
   }
 
   template <typename K, typename D, class H>
   HashTable <K,D,H>::HashTable (size_t n, H hashObject, bool prime)
-    :  numBuckets_(n), bucketVector_(0), hashObject_(hashObject), prime_(prime)
+    :  numBuckets_(n), bucketVector_(0), hashObject_(hashObject), prime_(prime), ladder_(0),
+       bloom_(0), bloomKeys_(0), bloomBits_(0)
   {
     // ensure at least 2 buckets
     if (numBuckets_ < 3)
       numBuckets_ = 2;
-    // optionally convert to prime number of buckets
+    // optionally convert to prime number of buckets: next rung of the prime ladder
     if (prime_)
-      numBuckets_ = fsu::PrimeBelow(numBuckets_);
+    {
+      ladder_ = fsu::PrimeLadderIndex(numBuckets_);
+      numBuckets_ = fsu::primeLadder[ladder_];
+    }
     // create buckets
     bucketVector_.SetSize(numBuckets_);
+    occupied_ = BitVector(numBuckets_);
   }
 
   // copies
 
   template <typename K, typename D, class H>
   HashTable <K,D,H>::HashTable (const HashTable& ht)
-    :  numBuckets_(ht.numBuckets_), bucketVector_(ht.bucketVector_), hashObject_(ht.hashObject_)
+    :  numBuckets_(ht.numBuckets_), bucketVector_(ht.bucketVector_), hashObject_(ht.hashObject_),
+       prime_(ht.prime_), ladder_(ht.ladder_), occupied_(ht.occupied_),
+       bloom_(ht.bloom_ ? new BitVector(*ht.bloom_) : 0), bloomKeys_(ht.bloomKeys_), bloomBits_(ht.bloomBits_)
   {}
 
   template <typename K, typename D, class H>
@@ -363,16 +984,48 @@ namespace fsu
       numBuckets_ = ht.numBuckets_;
       bucketVector_ = ht.bucketVector_;
       hashObject_ = ht.hashObject_;
+      prime_ = ht.prime_;
+      ladder_ = ht.ladder_;
+      occupied_ = ht.occupied_;
+      delete bloom_;
+      bloom_ = ht.bloom_ ? new BitVector(*ht.bloom_) : 0;
+      bloomKeys_ = ht.bloomKeys_;
+      bloomBits_ = ht.bloomBits_;
     }
     return *this;
   }
 
+  template <typename K, typename D, class H>
+  HashTable<K,D,H> HashTable <K,D,H>::Snapshot () const
+  {
+    HashTable<K,D,H> s(2, hashObject_, 0);
+    s.numBuckets_ = numBuckets_;
+    s.bucketVector_ = bucketVector_;
+    s.prime_ = prime_;
+    s.ladder_ = ladder_;
+    s.occupied_ = occupied_;
+    return s;
+  }
+
+  template <typename K, typename D, class H>
+  typename HashTable<K,D,H>::BucketType::Iterator HashTable<K,D,H>::Unshare (size_t b, typename BucketType::ConstIterator j)
+  {
+    const CowVector<BucketType>& buckets = bucketVector_;
+    size_t pos = 0;
+    for (typename BucketType::ConstIterator k = buckets[b].Begin(); k != j; ++k)
+      ++pos;
+    typename BucketType::Iterator i = bucketVector_[b].Begin();  // copies the chunk
+    while (pos-- > 0)
+      ++i;
+    return i;
+  }
+
   // other public methods
 
   template <typename K, typename D, class H>
   HashTable <K,D,H>::~HashTable ()
   {
-    Clear();
+    delete bloom_;  // buckets released by ~CowVector
   }
 
   template <typename K, typename D, class H>
@@ -380,8 +1033,15 @@ namespace fsu
   {
     if (nb == 0) nb = Size();
     HashTable<K,D,H> newTable(nb,hashObject_,prime_);
-    for (size_t i = 0; i < numBuckets_; ++i)
+    const CowVector<BucketType>& buckets = bucketVector_;
+    for (size_t i = occupied_.FindFirst(); i < numBuckets_; i = occupied_.FindNext(i))
     {
+      if (bucketVector_.Shared(i))  // a copy still uses it: read, don't copy to pop
+      {
+	for (typename BucketType::ConstIterator j = buckets[i].Begin(); j != buckets[i].End(); ++j)
+	  newTable.Insert((*j).key_,(*j).data_);
+	continue;
+      }
       while (!bucketVector_[i].Empty()) // pop as we go saves local space bloat
       {
 	newTable.Insert(bucketVector_[i].Back().key_,bucketVector_[i].Back().data_);
@@ -389,58 +1049,311 @@ namespace fsu
       }
     }
     fsu::Swap(numBuckets_,newTable.numBuckets_);
+    fsu::Swap(ladder_,newTable.ladder_);
     bucketVector_.Swap(newTable.bucketVector_);
+    occupied_ = newTable.occupied_;
+    if (bloom_)
+      BloomBuild();
   }
 
   template <typename K, typename D, class H>
-  void HashTable<K,D,H>::Clear ()
+  void HashTable<K,D,H>::Reserve (size_t nb)
+  // pre-sizing for loaders that know the record count in advance
   {
+    if (numBuckets_ < nb)
+      Rehash(nb);
+  }
+
+  template <typename K, typename D, class H>
+  bool HashTable<K,D,H>::Save (const char* path) const
+  {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    if (out.fail())
+    {
+      std::cerr << " ** HashTable::Save: unable to open " << path << '\n';
+      return 0;
+    }
+    const char * name = typeid(H).name();
+    std::string buf;
+    buf.append(hashsnap::magic, hashsnap::magicSize);
+    hashsnap::Put64(buf, numBuckets_);
+    hashsnap::Put64(buf, Size());
+    hashsnap::Put32(buf, prime_);
+    hashsnap::Put32(buf, (uint32_t)strlen(name));
+    buf.append(name);
     for (size_t i = 0; i < numBuckets_; ++i)
+    {
+      hashsnap::Put32(buf, (uint32_t)bucketVector_[i].Size());
+      for (typename BucketType::ConstIterator j = bucketVector_[i].Begin(); j != bucketVector_[i].End(); ++j)
+      {
+	hashsnap::Put64(buf, hashObject_((*j).key_));
+	hashsnap::Put(buf, (*j).key_);
+	hashsnap::Put(buf, (*j).data_);
+      }
+      if (buf.size() >= hashsnap::flushBytes)
+      {
+	out.write(buf.data(), buf.size());
+	buf.clear();
+      }
+    }
+    out.write(buf.data(), buf.size());
+    out.close();
+    if (out.fail())
+    {
+      std::cerr << " ** HashTable::Save: write to " << path << " failed\n";
+      return 0;
+    }
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  bool HashTable<K,D,H>::Load (const char* path, size_t nb)
+  {
+    // the whole file in one read
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (in.fail())
+    {
+      std::cerr << " ** HashTable::Load: unable to open " << path << '\n';
+      return 0;
+    }
+    in.seekg(0, std::ios::end);
+    std::string image((size_t)in.tellg(), '\0');
+    in.seekg(0, std::ios::beg);
+    in.read(&image[0], image.size());
+    if (in.fail())
+    {
+      std::cerr << " ** HashTable::Load: read from " << path << " failed\n";
+      return 0;
+    }
+
+    hashsnap::Reader r(image.data(), image.data() + image.size());
+    const char * name = typeid(H).name();
+    if (!r.Match(hashsnap::magic, hashsnap::magicSize))
+    {
+      std::cerr << " ** HashTable::Load: " << path << " is not a HashTable snapshot\n";
+      return 0;
+    }
+    size_t savedBuckets = r.Get64();
+    size_t savedSize    = r.Get64();
+    bool   savedPrime   = r.Get32() != 0;
+    if (r.Get32() != strlen(name) || !r.Match(name, strlen(name)))
+    {
+      std::cerr << " ** HashTable::Load: " << path << " was saved with a different hash class\n";
+      return 0;
+    }
+    // every bucket takes at least 4 bytes of the image and every entry at least 8:
+    // a damaged header must not size the table
+    if (savedBuckets == 0 || savedBuckets > r.Remaining() / 4
+	|| savedSize > (r.Remaining() - 4 * savedBuckets) / 8)
+    {
+      std::cerr << " ** HashTable::Load: " << path << " has a damaged header\n";
+      return 0;
+    }
+
+    // same bucket layout: restore buckets as saved; otherwise re-bucket by saved hash
+    if (nb == 0) nb = savedBuckets;
+    HashTable<K,D,H> newTable(nb, hashObject_, prime_);
+    bool direct = (newTable.numBuckets_ == savedBuckets && prime_ == savedPrime);
+    K k;
+    D d;
+    size_t count = 0;
+    for (size_t i = 0; i < savedBuckets && r.Ok(); ++i)
+    {
+      size_t n = r.Get32();
+      for (size_t j = 0; j < n && r.Ok(); ++j)
+      {
+	size_t h = r.Get64();
+	r.Get(k);
+	r.Get(d);
+	if (!r.Ok())
+	  break;
+	if (count == 0 && h != (size_t)hashObject_(k)) // hash objects of the same class can differ in state
+	{
+	  std::cerr << " ** HashTable::Load: " << path << " was saved with a different hash object\n";
+	  return 0;
+	}
+	if (direct && newTable.Reduce(h) != i)
+	{
+	  std::cerr << " ** HashTable::Load: " << path << " has an entry in the wrong bucket\n";
+	  return 0;
+	}
+	size_t bn = direct ? i : newTable.Reduce(h);
+	newTable.bucketVector_[bn].PushBack(EntryType(k,d));
+	newTable.occupied_.Set(bn);
+	++count;
+      }
+    }
+    if (!r.Ok() || count != savedSize)
+    {
+      std::cerr << " ** HashTable::Load: " << path << " is truncated\n";
+      return 0;
+    }
+    fsu::Swap(numBuckets_,newTable.numBuckets_);
+    fsu::Swap(ladder_,newTable.ladder_);
+    bucketVector_.Swap(newTable.bucketVector_);
+    occupied_ = newTable.occupied_;
+    if (bloom_)
+      BloomBuild();
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  void HashTable<K,D,H>::Clear ()
+  {
+    // shared chunks are swapped for empty ones rather than copied to be
+    // cleared; private chunks are cleared in place
+    bucketVector_.ReleaseShared();
+    for (size_t i = occupied_.FindFirst(); i < numBuckets_; i = occupied_.FindNext(i))
       bucketVector_[i].Clear();
+    occupied_.Unset();
+    if (bloom_)
+      bloom_->Unset();
+  }
+
+  template <typename K, typename D, class H>
+  void HashTable<K,D,H>::EnableBloom (size_t n, size_t bitsPerKey)
+  {
+    bloomKeys_ = (n > 0) ? n : numBuckets_;
+    bloomBits_ = (bitsPerKey > 0) ? bitsPerKey : 10;
+    BloomBuild();
+  }
+
+  template <typename K, typename D, class H>
+  void HashTable<K,D,H>::DisableBloom ()
+  {
+    delete bloom_;
+    bloom_ = 0;
+  }
+
+  template <typename K, typename D, class H>
+  bool HashTable<K,D,H>::BloomEnabled () const
+  {
+    return bloom_ != 0;
+  }
+
+  template <typename K, typename D, class H>
+  uint64_t HashTable<K,D,H>::BloomMix (uint64_t x)
+  {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+  }
+
+  template <typename K, typename D, class H>
+  void HashTable<K,D,H>::BloomAdd (size_t h)
+  {
+    // block from the high half of one mix, bloomProbes 9-bit offsets from a second
+    uint64_t x = BloomMix(h);
+    size_t base = (size_t)(((x >> 32) * (bloom_->Size() / bloomBlockBits)) >> 32) * bloomBlockBits;
+    uint64_t y = BloomMix(x);
+    for (size_t p = 0; p < bloomProbes; ++p, y >>= 9)
+      bloom_->Set(base + (y & (bloomBlockBits - 1)));
+  }
+
+  template <typename K, typename D, class H>
+  bool HashTable<K,D,H>::BloomTest (size_t h) const
+  {
+    uint64_t x = BloomMix(h);
+    size_t base = (size_t)(((x >> 32) * (bloom_->Size() / bloomBlockBits)) >> 32) * bloomBlockBits;
+    uint64_t y = BloomMix(x);
+    for (size_t p = 0; p < bloomProbes; ++p, y >>= 9)
+      if (!bloom_->Test(base + (y & (bloomBlockBits - 1))))
+	return 0;
+    return 1;
+  }
+
+  template <typename K, typename D, class H>
+  void HashTable<K,D,H>::BloomBuild ()
+  {
+    size_t n = Size();
+    if (bloomKeys_ < n)
+      bloomKeys_ = n;
+    size_t blocks = (bloomKeys_ * bloomBits_ + bloomBlockBits - 1) / bloomBlockBits;
+    if (blocks == 0) blocks = 1;
+    if (blocks > 0xFFFFFFFF) blocks = 0xFFFFFFFF;  // block index comes from 32 hash bits
+    delete bloom_;
+    bloom_ = new BitVector(blocks * bloomBlockBits);
+    for (size_t i = occupied_.FindFirst(); i < numBuckets_; i = occupied_.FindNext(i))
+      for (typename BucketType::ConstIterator j = bucketVector_[i].Begin(); j != bucketVector_[i].End(); ++j)
+	BloomAdd(hashObject_((*j).key_));
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H> HashTable<K,D,H>::Begin ()
+  {
+    return Iterator(static_cast<const HashTable&>(*this).Begin());
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H> HashTable<K,D,H>::End ()
+  {
+    return Iterator(static_cast<const HashTable&>(*this).End());
   }
 
   template <typename K, typename D, class H>
-  HashTableIterator<K,D,H> HashTable<K,D,H>::Begin () const
+  ConstHashTableIterator<K,D,H> HashTable<K,D,H>::Begin () const
   {
     // fsu::debug("Begin()");
-    HashTableIterator<K,D,H> i;
+    ConstHashTableIterator<K,D,H> i;
+    i.bucketNum_ = occupied_.FindFirst();
+    if (i.bucketNum_ >= numBuckets_)
+      return End();
     i.tablePtr_ = this;
-    i.bucketNum_ = 0;
-    while (i.bucketNum_ < numBuckets_ && bucketVector_[i.bucketNum_].Empty())
-      ++i.bucketNum_;
-    // now we either have the first non-empty bucket or we've exhausted the bucket numbers
-    if (i.bucketNum_ < numBuckets_)
-      i.bucketItr_ = bucketVector_[i.bucketNum_].Begin();
-    else
-    {
-      i.bucketNum_ = 0;
-      i.bucketItr_ = bucketVector_[i.bucketNum_].End();
-    }
+    i.bucketItr_ = bucketVector_[i.bucketNum_].Begin();
     return i;
   }
 
   template <typename K, typename D, class H>
-  HashTableIterator<K,D,H> HashTable<K,D,H>::End () const
+  ConstHashTableIterator<K,D,H> HashTable<K,D,H>::End () const
   {
     // fsu::debug("End()");
-    HashTableIterator<K,D,H> i;
+    ConstHashTableIterator<K,D,H> i;
     i.tablePtr_ = this;
-    i.bucketNum_ = numBuckets_ - 1;
     // experimental simplification made 8/15/14 by RCL
     // instead of End of last non-empty bucket, just return End of last bucket
-    // while ((bucketVector_[i.bucketNum_].Empty()) && (i.bucketNum_ > 0))
-    //   --i.bucketNum_;
-    // now either i.bucketNum_ is the last non-empty bucket or i.bucketNum_ is 0
-    // i.bucketItr_ = bucketVector_[i.bucketNum_].End();
-    i.bucketItr_ = bucketVector_[i.bucketNum_].End();
+    // further simplified: End() is the endBucket sentinel with a default
+    // bucket iterator; operator == recognizes it by bucketNum_ alone
+    i.bucketNum_ = ConstHashTableIterator<K,D,H>::endBucket;
     return i;
   }
 
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H> HashTable<K,D,H>::begin ()
+  {
+    return Begin();
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H> HashTable<K,D,H>::end ()
+  {
+    return End();
+  }
+
+  template <typename K, typename D, class H>
+  ConstHashTableIterator<K,D,H> HashTable<K,D,H>::begin () const
+  {
+    return Begin();
+  }
+
+  template <typename K, typename D, class H>
+  ConstHashTableIterator<K,D,H> HashTable<K,D,H>::end () const
+  {
+    return End();
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable<K,D,H>::NumBuckets () const
+  {
+    return numBuckets_;
+  }
+
   template <typename K, typename D, class H>
   size_t HashTable<K,D,H>::Size () const
   {
     size_t size(0);
-    for (size_t i = 0; i < numBuckets_; ++i)
+    for (size_t i = occupied_.FindFirst(); i < numBuckets_; i = occupied_.FindNext(i))
       size += bucketVector_[i].Size();
     return size;
   }
@@ -448,10 +1361,7 @@ namespace fsu
   template <typename K, typename D, class H>
   bool HashTable<K,D,H>::Empty () const
   {
-    for (size_t i = 0; i < numBuckets_; ++i)
-      if (!bucketVector_[i].Empty())
-        return 0;
-    return 1;
+    return occupied_.FindFirst() >= numBuckets_;
   }
 
   template <typename K, typename D, class H>
@@ -467,30 +1377,66 @@ namespace fsu
     }
   }
 
-  // private helper
+  // private helpers
+
+  template <typename K, typename D, class H>
+  typename HashTable<K,D,H>::BucketType::Iterator HashTable<K,D,H>::InsertAt (size_t bn, const K& k, const D& d)
+  {
+    EntryType e(k,d);
+    typename BucketType::Iterator j = bucketVector_[bn].Includes(e);
+
+    // new version works for all List ADTs
+    if (j == bucketVector_[bn].End())
+    {
+      j = bucketVector_[bn].Insert(e);
+      occupied_.Set(bn);
+    }
+    else
+    {
+      *j = e;
+    }
+    // */
+
+    /* // headless list version
+    if (j.Valid() && e == *j)   // if found, overwrite entry data
+      *j = e;                   
+    else                          // not found, insert new entry
+      j = bucketVector_[bn].Insert(e);
+    // */
+
+    return j;
+  }
 
   template <typename K, typename D, class H>
   size_t HashTable <K,D,H>::Index (const K& k) const
   {
-    return hashObject_ (k) % numBuckets_;
+    return Reduce(hashObject_ (k));
+  }
+
+  template <typename K, typename D, class H>
+  size_t HashTable <K,D,H>::Reduce (size_t h) const
+  {
+    if (prime_)
+      return fsu::PrimeLadderMod(h, ladder_);
+    return h % numBuckets_;
   }
 
   //--------------------------------------------
-  //     HashTableIterator <K,D,H>
+  //     ConstHashTableIterator <K,D,H>
   //--------------------------------------------
 
   template <typename K, typename D, class H>
-  HashTableIterator<K,D,H>::HashTableIterator () 
-    :  tablePtr_(0), bucketNum_(0), bucketItr_()
+  ConstHashTableIterator<K,D,H>::ConstHashTableIterator () 
+    :  tablePtr_(0), bucketNum_(endBucket), bucketItr_()
   {}
 
   template <typename K, typename D, class H>
-  HashTableIterator<K,D,H>::HashTableIterator (const Iterator& i)
+  ConstHashTableIterator<K,D,H>::ConstHashTableIterator (const ConstIterator& i)
     :  tablePtr_(i.tablePtr_), bucketNum_(i.bucketNum_), bucketItr_(i.bucketItr_)
   {}
 
   template <typename K, typename D, class H>
-  HashTableIterator <K,D,H>& HashTableIterator<K,D,H>::operator = (const Iterator& i)
+  ConstHashTableIterator <K,D,H>& ConstHashTableIterator<K,D,H>::operator = (const ConstIterator& i)
   {
     if (this != &i)
     {
@@ -502,105 +1448,87 @@ namespace fsu
   }
 
   template <typename K, typename D, class H>
-  HashTableIterator <K,D,H>& HashTableIterator<K,D,H>::operator ++ ()
+  ConstHashTableIterator <K,D,H>& ConstHashTableIterator<K,D,H>::operator ++ ()
   {
-    if (!Valid())
+    if (AtEnd())
       return *this;
     ++bucketItr_;
 
     // if bucketItr_ is at end of bucket, restart at beginning of next non-empty bucket
     if (bucketItr_ == tablePtr_->bucketVector_[bucketNum_].End())
     {
-      // do version
-      do
-      {
-	++bucketNum_;
-      }
-      while (bucketNum_ < tablePtr_->numBuckets_ && tablePtr_->bucketVector_[bucketNum_].Empty()); // */
-
-      /* // while version
-      ++bucketNum_;
-      while (bucketNum_ < tablePtr_->numBuckets_ && tablePtr_->bucketVector_[bucketNum_].Empty())
-      {
-	++bucketNum_;
-      } // */
-
+      // jump to the next non-empty bucket in the occupancy bitmap
+      bucketNum_ = tablePtr_->occupied_.FindNext(bucketNum_);
       if (bucketNum_ < tablePtr_->numBuckets_)
       {
 	bucketItr_ = tablePtr_->bucketVector_[bucketNum_].Begin();
       }
       else
       {
-	*this = tablePtr_->End();
+	bucketNum_ = endBucket;
+	bucketItr_ = typename BucketType::ConstIterator();
       }
     }
     return *this;
   }
 
   template <typename K, typename D, class H>
-  HashTableIterator <K,D,H> HashTableIterator<K,D,H>::operator ++ (int)
+  ConstHashTableIterator <K,D,H> ConstHashTableIterator<K,D,H>::operator ++ (int)
   {
-    HashTableIterator <K,D,H> i = *this;
+    ConstHashTableIterator <K,D,H> i = *this;
     operator ++();
     return i;
   }
 
-  /* Note: the following would be in Iterator, which would differ from ConstIterator by
-     (1) the underlying bucketItr_ would not be const
-     (2) adding Begin() and End() support
-     (3) adding this non-const dereference
-
   template <typename K, typename D, class H>
-  Entry<K,D>& HashTableIterator<K,D,H>::operator * () 
+  const Entry<K,D>& ConstHashTableIterator<K,D,H>::operator * () const
   {
-    if (!Valid())
+    if (AtEnd())
     {
       std::cerr << "** HashTableIterator error: invalid dereference\n";
       exit (EXIT_FAILURE);
     }
     return *bucketItr_;
   }
-  */
 
   template <typename K, typename D, class H>
-  const Entry<K,D>& HashTableIterator<K,D,H>::operator * () const
+  const Entry<K,D>* ConstHashTableIterator<K,D,H>::operator -> () const
   {
-    if (!Valid())
-    {
-      std::cerr << "** HashTableIterator error: invalid dereference\n";
-      exit (EXIT_FAILURE);
-    }
-    return *bucketItr_;
+    return &operator*();
   }
 
   template <typename K, typename D, class H>
-  bool HashTableIterator<K,D,H>::operator == (const Iterator& i2) const
+  bool ConstHashTableIterator<K,D,H>::operator == (const ConstIterator& i2) const
   {
-    if (!Valid() && !i2.Valid())
-      return 1;
-    if (Valid() && !i2.Valid())
-      return 0;
-    if (!Valid() && i2.Valid())
+    // iterators only ever rest at an entry or at the End() sentinel, so
+    // the loop test i != End() is one integer compare
+    if (bucketNum_ != i2.bucketNum_)
       return 0;
+    if (bucketNum_ == endBucket)   // End() of any table, or default constructed
+      return 1;
 
-    // now both are valid
+    // now both are at entries in the same bucket number
     if (tablePtr_ != i2.tablePtr_)
       return 0;
-    if (bucketNum_ != i2.bucketNum_)
-      return 0;
     if (bucketItr_ != i2.bucketItr_)
       return 0;
     return 1;
   }
 
   template <typename K, typename D, class H>
-  bool HashTableIterator<K,D,H>::operator != (const Iterator& i2) const
+  bool ConstHashTableIterator<K,D,H>::operator != (const ConstIterator& i2) const
   {
     return !(*this == i2);
   }
 
   template <typename K, typename D, class H>
-  bool HashTableIterator<K,D,H>::Valid () const
+  bool ConstHashTableIterator<K,D,H>::AtEnd () const
+  {
+    return bucketNum_ == endBucket;
+  }
+
+  template <typename K, typename D, class H>
+  bool ConstHashTableIterator<K,D,H>::Valid () const
   {
     if (tablePtr_ == 0)
       return 0;
@@ -609,6 +1537,78 @@ namespace fsu
     return bucketItr_ != tablePtr_->bucketVector_[bucketNum_].End();
   }
 
+  //--------------------------------------------
+  //     HashTableIterator <K,D,H>
+  //--------------------------------------------
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H>::HashTableIterator () 
+    :  ConstHashTableIterator<K,D,H>()
+  {}
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H>::HashTableIterator (const Iterator& i)
+    :  ConstHashTableIterator<K,D,H>(i)
+  {}
+
+  template <typename K, typename D, class H>
+  HashTableIterator<K,D,H>::HashTableIterator (const ConstIterator& i)
+    :  ConstHashTableIterator<K,D,H>(i)
+  {}
+
+  template <typename K, typename D, class H>
+  HashTableIterator <K,D,H>& HashTableIterator<K,D,H>::operator = (const Iterator& i)
+  {
+    ConstIterator::operator=(i);
+    return *this;
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator <K,D,H>& HashTableIterator<K,D,H>::operator ++ ()
+  {
+    ConstIterator::operator++();
+    return *this;
+  }
+
+  template <typename K, typename D, class H>
+  HashTableIterator <K,D,H> HashTableIterator<K,D,H>::operator ++ (int)
+  {
+    HashTableIterator <K,D,H> i = *this;
+    operator ++();
+    return i;
+  }
+
+  template <typename K, typename D, class H>
+  Entry<K,D>& HashTableIterator<K,D,H>::operator * () 
+  {
+    // the table is modifiable (see class note), so casting away const is safe;
+    // a bucket shared with a snapshot is copied before it can be written
+    if (!this->AtEnd() && this->tablePtr_->bucketVector_.Shared(this->bucketNum_))
+      this->bucketItr_ = const_cast< HashTable<K,D,H>* >(this->tablePtr_)->Unshare(this->bucketNum_, this->bucketItr_);
+    return const_cast< Entry<K,D>& >(ConstIterator::operator*());
+  }
+
+  template <typename K, typename D, class H>
+  const Entry<K,D>& HashTableIterator<K,D,H>::operator * () const
+  {
+    return ConstIterator::operator*();
+  }
+
+  template <typename K, typename D, class H>
+  Entry<K,D>* HashTableIterator<K,D,H>::operator -> ()
+  {
+    return &operator*();
+  }
+
+  template <typename K, typename D, class H>
+  const Entry<K,D>* HashTableIterator<K,D,H>::operator -> () const
+  {
+    return &operator*();
+  }
+
+  template <typename K, typename D, class H>
+  const size_t ConstHashTableIterator<K,D,H>::endBucket;
+
   #include <hashtbl.cpp> // implements Analysis and MaxBucketSize methods
 
 } // namespace fsu
@@ -0,0 +1,137 @@
+/*
+    lfqueue.h
+
+    LockFreeQueue<T> - bounded multi-producer multi-consumer FIFO
+
+    A ring of cells, each carrying a sequence number that tells producers
+    and consumers whether the cell is free for the current lap (D. Vyukov's
+    bounded MPMC queue). Push and Pop each cost one compare-and-swap on the
+    shared position and never block: they return false when the queue is
+    full or empty, and the caller decides whether to spin, yield or do
+    other work.
+
+    Capacity is rounded up to a power of 2. T must be copyable; small
+    types (pointers, indices) are intended.
+*/
+
+#ifndef _LFQUEUE_H
+#define _LFQUEUE_H
+
+#include <cstdlib>
+#include <atomic>
+
+namespace fsu
+{
+
+  template < typename T >
+  class LockFreeQueue
+  {
+  public:
+    typedef T ValueType;
+
+    explicit LockFreeQueue  (size_t capacity = 1024);
+             ~LockFreeQueue ();
+
+    bool     Push     (const T& t);  // false iff full
+    bool     Pop      (T& t);        // false iff empty
+    size_t   Capacity () const;
+
+  private:
+    struct Cell
+    {
+      std::atomic<size_t> sequence_;
+      T                   value_;
+    } ;
+
+    enum { cacheLine = 64 };
+
+    Cell *              cells_;
+    size_t              mask_;
+    char                pad0_ [cacheLine];
+    std::atomic<size_t> enqueuePos_;
+    char                pad1_ [cacheLine];
+    std::atomic<size_t> dequeuePos_;
+    char                pad2_ [cacheLine];
+
+    LockFreeQueue            (const LockFreeQueue&); // disallowed
+    LockFreeQueue& operator= (const LockFreeQueue&); // disallowed
+  } ;
+
+  template < typename T >
+  LockFreeQueue<T>::LockFreeQueue (size_t capacity)
+    : cells_(0), mask_(0), enqueuePos_(0), dequeuePos_(0)
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    cells_ = new Cell [size];
+    mask_  = size - 1;
+    for (size_t i = 0; i < size; ++i)
+      cells_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+
+  template < typename T >
+  LockFreeQueue<T>::~LockFreeQueue ()
+  {
+    delete [] cells_;
+  }
+
+  template < typename T >
+  bool LockFreeQueue<T>::Push (const T& t)
+  {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell * cell;
+    while (1)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence_.load(std::memory_order_acquire);
+      long diff = (long)seq - (long)pos;
+      if (diff == 0)
+      {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return 0;   // full
+      else
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+    cell->value_ = t;
+    cell->sequence_.store(pos + 1, std::memory_order_release);
+    return 1;
+  }
+
+  template < typename T >
+  bool LockFreeQueue<T>::Pop (T& t)
+  {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    Cell * cell;
+    while (1)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence_.load(std::memory_order_acquire);
+      long diff = (long)seq - (long)(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return 0;   // empty
+      else
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+    }
+    t = cell->value_;
+    cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+    return 1;
+  }
+
+  template < typename T >
+  size_t LockFreeQueue<T>::Capacity () const
+  {
+    return mask_ + 1;
+  }
+
+} // namespace fsu
+
+#endif
@@ -93,6 +93,47 @@ void List<T>::Merge (List<T>& y )
   (y.tail_)->prev_ = y.head_;
 }
 
+template < typename T >
+void List<T>::Splice (Iterator i, List<T>& y)
+// moves the elements of y, in order, in front of i; post: true = y.Empty()
+{
+  if (this == &y || y.Empty()) return;
+  if (i.curr_ == nullptr || i.curr_ == head_)
+  {
+    std::cerr << "** List error: Splice(i,list) called with vacuous iterator\n"; 
+    return;
+  }
+  Link * first = (y.head_)->next_;
+  Link * last  = (y.tail_)->prev_;
+
+  // make y structurally correct for empty
+  (y.head_)->next_ = y.tail_;
+  (y.tail_)->prev_ = y.head_;
+
+  // link first .. last in ahead of i
+  first->prev_ = i.curr_->prev_;
+  last->next_  = i.curr_;
+  i.curr_->prev_->next_ = first;
+  i.curr_->prev_ = last;
+}
+
+template < typename T >
+ListIterator<T> List<T>::Splice (Iterator i, List<T>& y, Iterator j)
+// moves the element at j of y in front of i; returns j at the following element of y
+{
+  if (i.curr_ == nullptr || i.curr_ == head_
+      || j.curr_ == nullptr || j.curr_ == y.head_ || j.curr_ == y.tail_)
+  {
+    std::cerr << "** List error: Splice(i,list,j) called with vacuous iterator\n"; 
+    return j;
+  }
+  Link * next = j.curr_->next_;
+  if (j.curr_ != i.curr_)
+    LinkIn(i.curr_, LinkOut(j.curr_));
+  j.curr_ = next;
+  return j;
+}
+
 template < typename T >
 void List<T>::Reverse ()
 {
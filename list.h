@@ -70,6 +70,8 @@ namespace fsu
     void      Sort      ();               // default order <
     void      Merge     (List<T>& list);  // merges "list" into this list
     void      Reverse   ();
+    void      Splice    (Iterator i, List<T>& list);             // moves all of list to i     [14]
+    Iterator  Splice    (Iterator i, List<T>& list, Iterator j); // moves item at j of list to i
 
     template < class Predicate > // Predicate object used to determine order
     void      Sort      (Predicate& p);
@@ -317,6 +319,12 @@ namespace fsu
      physically they are in different files.
 
 [13] Clone() is used in polymorphic programming
+
+[14] Splice relinks existing links: no allocation and no copy of T, in
+     constant time. Splice(i,list) moves every element of list, in order, in
+     front of i and leaves list empty. Splice(i,list,j) moves the element at j
+     in front of i and returns the position in list following j (as Remove(j)
+     would). Iterators to moved elements stay valid and now traverse this list.
 */
 
 #endif
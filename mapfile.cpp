@@ -0,0 +1,110 @@
+/*
+    mapfile.cpp
+
+    MappedFile class implementation
+*/
+
+#ifndef _MAPFILE_CPP
+#define _MAPFILE_CPP
+
+#include <iostream>
+#include <fstream>
+#include <new>       // std::nothrow
+#include <mapfile.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define FSU_HAVE_MMAP 1
+#endif
+
+namespace fsu
+{
+
+  MappedFile::MappedFile () : data_(0), size_(0), mapped_(0)
+  {}
+
+  MappedFile::~MappedFile ()
+  {
+    Close();
+  }
+
+  bool MappedFile::Open (const char* filename, bool sequential)
+  {
+    Close();
+#ifdef FSU_HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+      return 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void * p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        madvise(p, (size_t)st.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        data_   = (const char*)p;
+        size_   = (size_t)st.st_size;
+        mapped_ = 1;
+        close(fd);
+        return 1;
+      }
+    }
+    close(fd);
+#endif
+    // fallback: read the whole file into a buffer
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (ifs.fail())
+      return 0;
+    ifs.seekg(0, std::ios::end);
+    size_t size = (size_t)ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    char * buffer = new(std::nothrow) char [size + 1];
+    if (buffer == 0)
+    {
+      std::cerr << "** MappedFile error: memory allocation failure\n";
+      return 0;
+    }
+    ifs.read(buffer, size);
+    data_   = buffer;
+    size_   = (size_t)ifs.gcount();
+    mapped_ = 0;
+    return 1;
+  }
+
+  void MappedFile::Close ()
+  {
+    if (data_ != 0)
+    {
+#ifdef FSU_HAVE_MMAP
+      if (mapped_)
+        munmap((void*)data_, size_);
+      else
+#endif
+        delete [] data_;
+    }
+    data_   = 0;
+    size_   = 0;
+    mapped_ = 0;
+  }
+
+  bool MappedFile::IsOpen () const
+  {
+    return data_ != 0;
+  }
+
+  const char* MappedFile::Data () const
+  {
+    return data_;
+  }
+
+  size_t MappedFile::Size () const
+  {
+    return size_;
+  }
+
+} // namespace fsu
+
+#endif
@@ -0,0 +1,50 @@
+/*
+    mapfile.h
+
+    MappedFile class - read-only view of an entire file
+
+    Open(filename) maps the file into memory with mmap() where available,
+    so the bytes are read straight from the page cache with no copy. If
+    mapping is not available (or fails) the file is read into a buffer
+    instead; either way Data() .. Data() + Size() holds the file contents.
+
+    The access hint tells the kernel how the view will be read: sequential
+    (the default, for loaders: aggressive read-ahead) or random (for lookup
+    structures such as FrozenHashTable: no wasted read-ahead).
+
+    Not copyable: the view belongs to one object and is released by
+    Close() or the destructor.
+*/
+
+#ifndef _MAPFILE_H
+#define _MAPFILE_H
+
+#include <cstdlib>   // size_t
+
+namespace fsu
+{
+
+  class MappedFile
+  {
+  public:
+                 MappedFile  ();
+                 ~MappedFile ();
+
+    bool         Open        (const char* filename, bool sequential = 1); // false if the file cannot be read
+    void         Close       ();
+    bool         IsOpen      () const;
+    const char*  Data        () const;
+    size_t       Size        () const;
+
+  private:
+    const char*  data_;
+    size_t       size_;
+    bool         mapped_;   // true: data_ is an mmap view, false: a new[] buffer
+
+                 MappedFile  (const MappedFile&);   // disallowed
+    MappedFile&  operator =  (const MappedFile&);   // disallowed
+  } ;
+
+} // namespace fsu
+
+#endif
@@ -0,0 +1,301 @@
+/*
+    mphf.h
+
+    PerfectHashTable <K, D> - static table over a minimal perfect hash
+
+    For a fixed set of n keys, a minimal perfect hash function (MPHF) maps
+    the keys one-to-one onto 0 .. n-1. This one is built BBHash style on
+    fsu::BitVector:
+
+      level 0 is a bit vector of about gamma * n bits; every key is hashed
+      to one position. Positions hit by exactly one key are set; keys that
+      collided go on to level 1, a vector of gamma * (colliding keys) bits
+      with an independent hash, and so on until no keys remain.
+
+      The MPHF value of a key is the number of set bits before its
+      position, over all levels: levelRank_[l] + levels_[l].Rank1(pos).
+
+    With gamma = 1 about 1/e of the keys fall through each level, so the
+    levels hold about e * n bits, plus the BitVector rank directory (3/8 bit
+    per bit): roughly 3.7 bits of index per key. A lookup visits 1.6 levels
+    on average, all in small cache-resident vectors, then makes exactly one
+    probe into the entry array, where the stored key is compared so that
+    keys outside the set are rejected.
+
+    Keys are hashed once to 64 bits (KeyHash, over the key bytes as in
+    frozen.h); each level remixes that value with its own seed, so building
+    costs one pass over the key bytes. Should two keys share a 64-bit hash,
+    the build restarts with a new seed.
+
+    Build(table) takes any table with ConstIterator, Begin(), End() and
+    entries with key_ and data_ (HashTable, for one). Build(filename)
+    loads a text or binary table file (tblload.h); duplicate keys keep the
+    last data, as HashTable::Insert would. The deduplicating table is sized
+    from the file's record count (tblload::CountRecords) before loading, so
+    its chains stay short.
+*/
+
+#ifndef _MPHF_H
+#define _MPHF_H
+
+#include <cstdlib>
+#include <stdint.h>
+#include <bitvect.h>
+#include <vector.h>
+#include <pair.h>
+#include <hashtbl.h>
+#include <tblload.h>
+#include <frozen.h>   // frozen::KeyData, frozen::KeyLength
+
+namespace fsu
+{
+
+  namespace mphf
+  {
+    static const size_t maxLevels = 64;
+
+    inline uint64_t Mix (uint64_t x)
+    {
+      x ^= x >> 33;
+      x *= 0xFF51AFD7ED558CCDULL;
+      x ^= x >> 33;
+      x *= 0xC4CEB9FE1A85EC53ULL;
+      return x ^ (x >> 33);
+    }
+
+    // 64-bit hash of n bytes
+    inline uint64_t Bytes (const char* p, size_t n, uint64_t seed)
+    {
+      uint64_t h = seed ^ (n * 0x9E3779B97F4A7C15ULL);
+      for ( ; n >= 8; n -= 8, p += 8)
+      {
+        uint64_t w = 0;
+        for (size_t i = 0; i < 8; ++i)
+          w |= (uint64_t)(unsigned char)p[i] << (8 * i);
+        h = Mix(h ^ w) * 0x9E3779B97F4A7C15ULL;
+      }
+      uint64_t w = 0;
+      for (size_t i = 0; i < n; ++i)
+        w |= (uint64_t)(unsigned char)p[i] << (8 * i);
+      return Mix(h ^ w);
+    }
+
+    // position in [0, m) of level hash h, without division
+    inline size_t Reduce (uint64_t h, size_t m)
+    {
+#if defined(__SIZEOF_INT128__)
+      return (size_t)(((unsigned __int128)h * m) >> 64);
+#else
+      return (size_t)(h % m);
+#endif
+    }
+
+    inline uint64_t LevelHash (uint64_t h, size_t level)
+    {
+      return Mix(h + (level + 1) * 0xD1B54A32D192ED03ULL);
+    }
+
+    // hash functor over key bytes; also serves as H for the deduplicating load table
+    template < typename K >
+    class KeyHash
+    {
+    public:
+      KeyHash (uint64_t seed = 0) : seed_(seed) {}
+      uint64_t operator () (const K& k) const
+      {
+        return Bytes(frozen::KeyData(k, 0), frozen::KeyLength(k, 0), seed_);
+      }
+    private:
+      uint64_t seed_;
+    } ;
+  } // namespace mphf
+
+  template <typename K, typename D>
+  class PerfectHashTable
+  {
+  public:
+    typedef K                     KeyType;
+    typedef D                     DataType;
+    typedef fsu::Pair<K,D>        EntryType;
+
+    explicit     PerfectHashTable (double gamma = 1.0);
+
+    template < class T >
+    bool         Build         (const T& table);         // false if the build failed
+    bool         Build         (const char* filename);   // false if the file cannot be read
+
+    bool         Includes      (const K& k) const;
+    bool         Retrieve      (const K& k, D& d) const;
+    size_t       Size          () const;
+
+    // for analysis
+    size_t       Levels        () const;
+    size_t       IndexBits     () const;  // level vectors plus rank directories
+    size_t       MemoryBytes   () const;  // index + entry array (excluding key-owned storage)
+
+  private:
+    double                      gamma_;
+    uint64_t                    seed_;
+    fsu::Vector < BitVector >   levels_;
+    fsu::Vector < size_t >      levelRank_;  // set bits in levels before level l
+    fsu::Vector < EntryType >   entries_;    // entries_[MPHF(k)] holds k
+
+    size_t       Lookup        (uint64_t h) const;  // MPHF value of key hash h, or Size()
+    bool         BuildLevels   (const fsu::Vector<uint64_t>& hashes);
+  } ;
+
+  template <typename K, typename D>
+  PerfectHashTable<K,D>::PerfectHashTable (double gamma)
+    : gamma_(gamma < 1.0 ? 1.0 : gamma), seed_(0), levels_(0), levelRank_(0), entries_(0)
+  {}
+
+  template <typename K, typename D>
+  bool PerfectHashTable<K,D>::BuildLevels (const fsu::Vector<uint64_t>& hashes)
+  // false if keys still collide after maxLevels (equal 64-bit hashes)
+  {
+    levels_.Clear();
+    levelRank_.Clear();
+    fsu::Vector < uint64_t > keys (hashes), next;
+    size_t rank = 0;
+    for (size_t l = 0; keys.Size() > 0; ++l)
+    {
+      if (l == mphf::maxLevels)
+        return 0;
+      size_t m = (size_t)(gamma_ * keys.Size()) + 1;
+      BitVector hit(m), collide(m);
+      m = hit.Size();
+      for (size_t i = 0; i < keys.Size(); ++i)
+      {
+        size_t pos = mphf::Reduce(mphf::LevelHash(keys[i], l), m);
+        if (hit.Test(pos))
+          collide.Set(pos);
+        else
+          hit.Set(pos);
+      }
+      hit.Xor(collide);   // collide is a subset of hit: keep single hits only
+      next.Clear();
+      for (size_t i = 0; i < keys.Size(); ++i)
+        if (collide.Test(mphf::Reduce(mphf::LevelHash(keys[i], l), m)))
+          next.PushBack(keys[i]);
+      levelRank_.PushBack(rank);
+      rank += hit.Count();
+      levels_.PushBack(hit);
+      keys.Swap(next);
+    }
+    for (size_t l = 0; l < levels_.Size(); ++l)
+      levels_[l].BuildIndex();  // now, so concurrent lookups are read-only
+    return 1;
+  }
+
+  template <typename K, typename D>
+  template <class T>
+  bool PerfectHashTable<K,D>::Build (const T& table)
+  {
+    fsu::Vector < EntryType > pairs;
+    for (typename T::ConstIterator i = table.Begin(); i != table.End(); ++i)
+      pairs.PushBack(EntryType((*i).key_, (*i).data_));
+    fsu::Vector < uint64_t > hashes (pairs.Size());
+    for (seed_ = 0; seed_ < 8; ++seed_)
+    {
+      mphf::KeyHash<K> kh(mphf::Mix(seed_));
+      for (size_t i = 0; i < pairs.Size(); ++i)
+        hashes[i] = kh(pairs[i].first_);
+      if (BuildLevels(hashes))
+        break;
+    }
+    if (seed_ == 8)
+    {
+      std::cerr << " ** PerfectHashTable::Build: keys collide under every seed (duplicate keys?)\n";
+      levels_.Clear();
+      levelRank_.Clear();
+      entries_.Clear();
+      return 0;
+    }
+    entries_.SetSize(pairs.Size());
+    for (size_t i = 0; i < pairs.Size(); ++i)
+      entries_[Lookup(hashes[i])] = pairs[i];
+    return 1;
+  }
+
+  template <typename K, typename D>
+  bool PerfectHashTable<K,D>::Build (const char* filename)
+  {
+    fsu::MappedFile file;
+    if (!file.Open(filename))
+    {
+      std::cerr << " ** PerfectHashTable::Build: unable to open " << filename << '\n';
+      return 0;
+    }
+    // HashTable does not rehash as it grows: size it for every record up front.
+    // CountRecords is bounded by the file size, so records + 1 cannot wrap
+    // however damaged the header is.
+    size_t records = tblload::CountRecords(file.Data(), file.Data() + file.Size());
+    fsu::HashTable < K, D, mphf::KeyHash<K> > table(records + 1, mphf::KeyHash<K>(), 0);
+    size_t count;
+    fsu::LoadTable(file, table, count);
+    file.Close();
+    return Build(table);
+  }
+
+  template <typename K, typename D>
+  size_t PerfectHashTable<K,D>::Lookup (uint64_t h) const
+  {
+    for (size_t l = 0; l < levels_.Size(); ++l)
+    {
+      const BitVector& level = levels_[l];
+      size_t pos = mphf::Reduce(mphf::LevelHash(h, l), level.Size());
+      if (level.Test(pos))
+        return levelRank_[l] + level.Rank1(pos);
+    }
+    return entries_.Size();
+  }
+
+  template <typename K, typename D>
+  bool PerfectHashTable<K,D>::Includes (const K& k) const
+  {
+    D d;
+    return Retrieve(k, d);
+  }
+
+  template <typename K, typename D>
+  bool PerfectHashTable<K,D>::Retrieve (const K& k, D& d) const
+  {
+    size_t i = Lookup(mphf::KeyHash<K>(mphf::Mix(seed_))(k));
+    if (i < entries_.Size() && entries_[i].first_ == k)
+    {
+      d = entries_[i].second_;
+      return 1;
+    }
+    return 0;
+  }
+
+  template <typename K, typename D>
+  size_t PerfectHashTable<K,D>::Size () const
+  {
+    return entries_.Size();
+  }
+
+  template <typename K, typename D>
+  size_t PerfectHashTable<K,D>::Levels () const
+  {
+    return levels_.Size();
+  }
+
+  template <typename K, typename D>
+  size_t PerfectHashTable<K,D>::IndexBits () const
+  {
+    size_t bits = 0;
+    for (size_t l = 0; l < levels_.Size(); ++l)
+      bits += levels_[l].Size();
+    return bits + (3 * bits) / 8 + 64 * levelRank_.Size();
+  }
+
+  template <typename K, typename D>
+  size_t PerfectHashTable<K,D>::MemoryBytes () const
+  {
+    return IndexBits() / 8 + entries_.Size() * sizeof(EntryType);
+  }
+
+} // namespace fsu
+
+#endif
@@ -0,0 +1,287 @@
+/*
+    parload.h
+
+    ParallelLoad (filename, tables, numTables, numReaders, stats, presize)
+
+    Pipelined parallel version of LoadTable (tblload.h). The mapped input
+    is cut into numReaders chunks at newline boundaries (text) or record
+    boundaries (binary, tblfmt.h), taken from the file's sync index by
+    binary search, so no thread walks the file before the readers start.
+    Only a binary file without an index has its boundaries found by
+    stepping over the records up to each cut. Each reader thread
+    scans its chunk and routes every record, by a hash of the key bytes,
+    to one of numTables partitions. Records travel in batches through one
+    bounded LockFreeQueue per partition to an inserter thread that owns
+    that partition's table, so no table is ever shared between threads.
+
+    The routing hash (FNV-1a, high bits) is independent of the tables'
+    own hash objects, so partitioning does not bias bucket distribution.
+
+    LoadStats reports, per stage, the summed busy and elapsed seconds of
+    its threads: a stage whose busy / elapsed ratio is near 1 while the
+    other stage waits is the bottleneck.
+*/
+
+#ifndef _PARLOAD_H
+#define _PARLOAD_H
+
+#include <cstdlib>
+#include <stdint.h>
+#include <thread>
+#include <chrono>
+#include <tblload.h>
+#include <lfqueue.h>
+
+namespace fsu
+{
+
+  struct LoadStats
+  {
+    size_t  records;      // records inserted
+    size_t  bytes;        // input size
+    double  seconds;      // wall time, mapping to last insert
+    double  readBusy;     // reader thread seconds spent scanning
+    double  readTotal;    // reader thread seconds, including waits on full queues
+    double  insertBusy;   // inserter thread seconds spent inserting
+    double  insertTotal;  // inserter thread seconds, including waits on empty queues
+  } ;
+
+  namespace parload
+  {
+    static const size_t queueCapacity = 64; // batches in flight per partition
+
+    inline double Seconds (std::chrono::steady_clock::time_point start)
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    inline size_t Partition (const char* k, size_t klen, size_t numTables)
+    {
+      uint64_t h = 14695981039346656037ULL;
+      for (size_t i = 0; i < klen; ++i)
+      {
+        h ^= (unsigned char)k[i];
+        h *= 1099511628211ULL;
+      }
+      return (size_t)((h >> 32) % numTables);
+    }
+
+    template < class T >
+    struct Batch
+    {
+      typedef fsu::Pair < typename T::KeyType , typename T::DataType > PairType;
+      Batch () : pairs_(tblload::batchSize), n_(0) {}
+      fsu::Vector < PairType > pairs_;
+      size_t                   n_;
+    } ;
+
+    template < class T >
+    class ReaderSink
+    {
+    public:
+      typedef LockFreeQueue < Batch<T>* > QueueType;
+
+      ReaderSink (QueueType** queues, size_t numTables)
+        : queues_(queues), numTables_(numTables), batches_(numTables), wait_(0)
+      {
+        for (size_t i = 0; i < numTables_; ++i)
+          batches_[i] = new Batch<T>;
+      }
+      void operator () (const char* k, size_t klen, long long d)
+      {
+        size_t p = Partition(k, klen, numTables_);
+        Batch<T> * b = batches_[p];
+        b->pairs_[b->n_].first_  = key_(k, klen);
+        b->pairs_[b->n_].second_ = tblload::ToData < typename T::DataType > (d);
+        if (++b->n_ == tblload::batchSize)
+        {
+          Send(p, b);
+          batches_[p] = new Batch<T>;
+        }
+      }
+      void Finish ()
+      {
+        for (size_t p = 0; p < numTables_; ++p)
+        {
+          if (batches_[p]->n_ > 0)
+            Send(p, batches_[p]);
+          else
+            delete batches_[p];
+          Send(p, 0); // end marker from this reader
+        }
+      }
+      double Wait () const { return wait_; }
+    private:
+      void Send (size_t p, Batch<T>* b)
+      {
+        if (queues_[p]->Push(b))
+          return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (!queues_[p]->Push(b))
+          std::this_thread::yield();
+        wait_ += Seconds(start);
+      }
+      QueueType **                         queues_;
+      size_t                               numTables_;
+      fsu::Vector < Batch<T>* >            batches_;
+      tblload::KeyMaker < typename T::KeyType > key_;
+      double                               wait_;
+    } ;
+
+    template < class T >
+    void Reader (const char* p, const char* e, bool binary, LockFreeQueue< Batch<T>* >** queues,
+                 size_t numTables, double* busy, double* total)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      ReaderSink<T> sink(queues, numTables);
+      if (binary)
+        tblfmt::ScanBinary(p, e, sink);
+      else
+        tblload::ScanRecords(p, e, sink);
+      sink.Finish();
+      *total = Seconds(start);
+      *busy  = *total - sink.Wait();
+    }
+
+    template < class T >
+    void Inserter (T* table, LockFreeQueue< Batch<T>* >* queue, size_t numReaders,
+                   size_t* records, double* busy, double* total)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      double wait = 0;
+      size_t ends = 0;
+      *records = 0;
+      while (ends < numReaders)
+      {
+        Batch<T> * b;
+        if (!queue->Pop(b))
+        {
+          std::chrono::steady_clock::time_point w = std::chrono::steady_clock::now();
+          while (!queue->Pop(b))
+            std::this_thread::yield();
+          wait += Seconds(w);
+        }
+        if (b == 0)
+        {
+          ++ends;
+          continue;
+        }
+        *records += table->Insert(b->pairs_.Begin(), b->pairs_.Begin() + b->n_);
+        delete b;
+      }
+      *total = Seconds(start);
+      *busy  = *total - wait;
+    }
+  } // namespace parload
+
+  template < class T >
+  bool ParallelLoad (const char* filename, T** tables, size_t numTables, size_t numReaders, LoadStats& stats,
+                     bool presize = 0)
+  {
+    typedef parload::Batch<T> BatchType;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stats.records = stats.bytes = 0;
+    stats.seconds = stats.readBusy = stats.readTotal = stats.insertBusy = stats.insertTotal = 0;
+    if (numTables == 0) numTables = 1;
+    if (numReaders == 0) numReaders = 1;
+
+    fsu::MappedFile file;
+    if (!file.Open(filename))
+      return 0;
+    stats.bytes = file.Size();
+
+    // chunk boundaries: just past the first newline at or after size * r / numReaders;
+    // binary records cannot be found from an arbitrary byte, so the cut is the
+    // first sync point (tblfmt.h) at or after that offset, found by binary search.
+    // A binary file without a sync index is stepped over by its length prefixes
+    const char * data = file.Data();
+    const bool binary = tblfmt::IsBinary(data, file.Size());
+    const char * e    = binary ? tblfmt::RecordsEnd(data, file.Size()) : data + file.Size();
+    const char * index = 0;
+    size_t syncPoints  = 0;
+    const bool synced  = binary && tblfmt::FindIndex(data, file.Size(), index, syncPoints)
+                         && tblfmt::CheckIndex(data, index, syncPoints);
+    fsu::Vector < const char* > cut (numReaders + 1);
+    cut[0] = binary ? data + tblfmt::headerSize : data;
+    cut[numReaders] = e;
+    if (presize && binary)
+      for (size_t i = 0; i < numTables; ++i)
+        tables[i]->Reserve(tblfmt::RecordCount(data, file.Size()) / numTables + 1);
+    for (size_t r = 1; r < numReaders; ++r)
+    {
+      const char * c = data + (file.Size() / numReaders) * r;
+      if (c < cut[r-1]) c = cut[r-1];
+      if (synced)
+      {
+        size_t lo = 0, hi = syncPoints;   // first sync point at or after c
+        while (lo < hi)
+        {
+          size_t mid = lo + (hi - lo) / 2;
+          if (tblfmt::IndexEntry(index, mid) < (uint64_t)(c - data))
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+        uint64_t offset = (lo < syncPoints) ? tblfmt::IndexEntry(index, lo) : (uint64_t)(e - data);
+        c = (offset < (uint64_t)(e - data)) ? data + offset : e;
+        if (c < cut[r-1]) c = cut[r-1];
+      }
+      else if (binary)
+      {
+        const char * b = cut[r-1];
+        const char * n;
+        while (b < c && (n = tblfmt::NextRecord(b, e)) != 0)
+          b = n;
+        c = (b < c) ? e : b;
+      }
+      else
+      {
+        while (c != e && *c != '\n')
+          ++c;
+        if (c != e) ++c;
+      }
+      cut[r] = c;
+    }
+
+    fsu::Vector < LockFreeQueue < BatchType* > * > queues (numTables);
+    for (size_t i = 0; i < numTables; ++i)
+      queues[i] = new LockFreeQueue < BatchType* > (parload::queueCapacity);
+    fsu::Vector < double > rBusy(numReaders, 0.0), rTotal(numReaders, 0.0);
+    fsu::Vector < double > iBusy(numTables, 0.0), iTotal(numTables, 0.0);
+    fsu::Vector < size_t > iRecords(numTables, 0);
+    std::thread * inserters = new std::thread [numTables];
+    std::thread * readers   = new std::thread [numReaders];
+
+    for (size_t i = 0; i < numTables; ++i)
+      inserters[i] = std::thread(parload::Inserter<T>, tables[i], queues[i], numReaders,
+                                 &iRecords[i], &iBusy[i], &iTotal[i]);
+    for (size_t r = 0; r < numReaders; ++r)
+      readers[r] = std::thread(parload::Reader<T>, cut[r], cut[r+1], binary, &queues[0], numTables,
+                               &rBusy[r], &rTotal[r]);
+    for (size_t r = 0; r < numReaders; ++r)
+      readers[r].join();
+    for (size_t i = 0; i < numTables; ++i)
+      inserters[i].join();
+
+    for (size_t r = 0; r < numReaders; ++r)
+    {
+      stats.readBusy  += rBusy[r];
+      stats.readTotal += rTotal[r];
+    }
+    for (size_t i = 0; i < numTables; ++i)
+    {
+      stats.records     += iRecords[i];
+      stats.insertBusy  += iBusy[i];
+      stats.insertTotal += iTotal[i];
+    }
+    delete [] readers;
+    delete [] inserters;
+    for (size_t i = 0; i < numTables; ++i)
+      delete queues[i];
+    stats.seconds = parload::Seconds(start);
+    return 1;
+  }
+
+} // namespace fsu
+
+#endif
@@ -5,98 +5,320 @@
 
     implementations of functions prototyped in primes.h
 
+    The sieve is segmented and stores odd numbers only: a segment is a
+    BitVector of segmentBits bits in which bit j represents lo + 2j for an
+    odd lo. A segment is 32 KB, so it stays in L1/L2 cache while every base
+    prime crosses off its multiples. Base primes >= 7 step through their
+    multiples p*m with m restricted to the residues coprime to 30 (a mod 30
+    wheel), skipping the multiples already removed by 2, 3 and 5.
+
+    PrimeBelow and PrimeAbove do not sieve at all: they step through odd
+    candidates with IsPrime(), a deterministic 64-bit Miller-Rabin test.
+
     Copyright 2009, R.C. Lacher
 */
 
 #ifndef _PRIMES_CCP
 #define _PRIMES_CCP
 
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <primes.h>
 
 namespace fsu
 {
 
-  static const size_t maxPrime = 99999989; // largest prime < 100000000
-  // maxPrime needs to be a prime number less than max size_t
-  // used by PrimeAbove only
+  static const size_t segmentBits = 262144; // odd-only segment: 32 KB, 524288 integers
+
+  // mod 30 wheel: gaps between successive residues coprime to 30, starting at 1
+  static const size_t wheelResidue [8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+  static const size_t wheelGap     [8] = { 6, 4,  2,  4,  2,  4,  6,  2 };
+
+  static size_t ISqrt (size_t n)
+  // returns floor(sqrt(n))
+  {
+    size_t r = (size_t)std::sqrt((double)n);
+    while (r > 0 && r > n / r)
+      --r;
+    while ((r + 1) <= n / (r + 1))
+      ++r;
+    return r;
+  }
+
+  static void BasePrimes (size_t limit, fsu::BitVector& base)
+  // post: for odd k <= limit, k is prime iff base.Test(k/2)
+  //       small enough to be sieved in one pass
+  {
+    base = fsu::BitVector(limit / 2 + 1);
+    base.Set();
+    base.Unset(0); // 1 is not prime
+    for (size_t p = 3; p * p <= limit; p += 2)
+      if (base.Test(p/2))
+        for (size_t j = p * p; j <= limit; j += 2 * p)
+          base.Unset(j/2);
+    for (size_t j = limit / 2 + 1; j < base.Size(); ++j)
+      base.Unset(j);
+  }
+
+  static void SieveSegment (size_t lo, size_t hi, const fsu::BitVector& base, fsu::BitVector& seg)
+  // pre:  lo is odd, hi - lo <= 2 * segmentBits, base covers sqrt(hi)
+  // post: for lo + 2j < hi, lo + 2j is prime iff seg.Test(j); all other bits are 0
+  {
+    const size_t count = (hi - lo + 1) / 2;
+    seg.Set();
+    for (size_t j = count; j < seg.Size(); ++j)
+      seg.Unset(j);
+    if (lo == 1)
+      seg.Unset(0); // 1 is not prime
+
+    for (size_t b = base.FindFirst(); b < base.Size(); b = base.FindNext(b))
+    {
+      const size_t p = 2 * b + 1;
+      if (p > hi / p)
+        break;
+      if (p < 7)
+      {
+        // 3 and 5: every odd multiple from max(p*p, lo)
+        size_t x = p * p;
+        if (x < lo)
+        {
+          x = ((lo + p - 1) / p) * p;
+          if (x % 2 == 0) x += p;
+        }
+        for ( ; x < hi; x += 2 * p)
+          seg.Unset((x - lo) / 2);
+        continue;
+      }
+      // p >= 7: multiples p*m with m coprime to 30, m >= p
+      size_t m = (lo + p - 1) / p;
+      if (m < p) m = p;
+      size_t k = 0;
+      size_t r = m % 30;
+      while (wheelResidue[k] < r) // terminates: wheelResidue[7] = 29 >= r
+        ++k;
+      m += wheelResidue[k] - r;
+      if (m > (hi - 1) / p)
+        continue;
+      for (size_t x = p * m; ; )
+      {
+        seg.Unset((x - lo) / 2);
+        size_t step = p * wheelGap[k];
+        if (hi - x <= step)
+          break;
+        x += step;
+        k = (k + 1) & 7;
+      }
+    }
+  }
+
+  static size_t MulMod (size_t a, size_t b, size_t m)
+  // returns a * b mod m without overflow
+  {
+#if defined(__SIZEOF_INT128__)
+    return (size_t)(((unsigned __int128)a * b) % m);
+#else
+    size_t r = 0;
+    a %= m;
+    while (b > 0)
+    {
+      if (b & 1)
+	r = (r >= m - a) ? r - (m - a) : r + a;
+      b >>= 1;
+      a = (a >= m - a) ? a - (m - a) : a + a;
+    }
+    return r;
+#endif
+  }
+
+  static size_t PowMod (size_t a, size_t e, size_t m)
+  // returns a^e mod m
+  {
+    size_t r = 1;
+    a %= m;
+    while (e > 0)
+    {
+      if (e & 1)
+	r = MulMod(r, a, m);
+      a = MulMod(a, a, m);
+      e >>= 1;
+    }
+    return r;
+  }
+
+  static bool StrongProbablePrime (size_t n, size_t a, size_t d, size_t s)
+  // Miller-Rabin round: n - 1 = d * 2^s with d odd
+  {
+    a %= n;
+    if (a == 0)
+      return 1;
+    size_t x = PowMod(a, d, n);
+    if (x == 1 || x == n - 1)
+      return 1;
+    for (size_t i = 1; i < s; ++i)
+    {
+      x = MulMod(x, x, n);
+      if (x == n - 1)
+	return 1;
+    }
+    return 0;
+  }
+
+  bool IsPrime (size_t n)
+  // deterministic for all 64-bit n: trial division by primes < 50, then
+  // Miller-Rabin with the 7 bases of Jim Sinclair, which have no common
+  // strong pseudoprime below 2^64
+  {
+    static const size_t smallPrimes [15] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47 };
+    static const size_t bases [7] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+    if (n < 2)
+      return 0;
+    for (size_t i = 0; i < 15; ++i)
+    {
+      if (n == smallPrimes[i])
+	return 1;
+      if (n % smallPrimes[i] == 0)
+	return 0;
+    }
+    if (n < 53 * 53)
+      return 1;
+    size_t d = n - 1, s = 0;
+    while ((d & 1) == 0)
+    {
+      d >>= 1;
+      ++s;
+    }
+    for (size_t i = 0; i < 7; ++i)
+      if (!StrongProbablePrime(n, bases[i], d, s))
+	return 0;
+    return 1;
+  }
 
   size_t PrimeBelow (size_t n)
   // returns largest prime number <= n
-  // This is likely to be more efficient than PrimeAbove(), because
-  // it only needs a bitvector of size n+1
+  // prime gaps below 2^64 are under 1600, so this is a short IsPrime() walk
   {
     if (n <= 1)
       {
 	return 0;
       }
-
-    if (n < n + 1) // n is not the largest size_t
-      ++n;         // otherwise n is a power of 2 and hence not prime
-    fsu::BitVector b(n);
-    Sieve(b);
-    --n;
-    while (n > 2)
-      {
-	if (b.Test(n))
-	  return n;
-	--n;
-      }
-    return 2;
+    if (n <= 2)
+      return 2;
+    if (n % 2 == 0)
+      --n;
+    while (!IsPrime(n))
+      n -= 2;
+    return n;
   }
 
   size_t PrimeAbove (size_t n)
   // returns smallest prime number >= n
   // or zero if input is too large
   {
-    if (n > maxPrime)
-      {
-	std::cerr << "** input too large for PrimeAbove()\n";
-	return 0;
-      }
-    if (n == maxPrime)
-      return maxPrime;
-    fsu::BitVector b (maxPrime);
-    Sieve(b);
-    while (n < maxPrime)
-      {
-	if (b.Test(n))
-	  return n;
-	++n;
-      }
-    return maxPrime;
+    if (n <= 2)
+      return 2;
+    if (n % 2 == 0)
+      ++n;
+    for ( ; n > 2; n += 2) // n wraps to a small odd value past max size_t
+      if (IsPrime(n))
+	return n;
+    std::cerr << "** input too large for PrimeAbove()\n";
+    return 0;
   }
 
-  void AllPrimesBelow (size_t n, std::ostream& os)
-  // writes all primes <= n to os
+  size_t PrimeLadderIndex (size_t n)
+  // binary search for smallest ladder entry >= n
   {
-    if (n < n + 1) // n is not the largest size_t
-      ++n;
-    fsu::BitVector b(n);
-    Sieve(b);
+    size_t lo = 0, hi = primeLadderSize - 1;
+    while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (primeLadder[mid] < n)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+    return lo;
+  }
 
-    for (size_t i = 0; i < n; ++i)
-      if (b.Test(i))
-	os << ' ' << i;
+  static void WriteSegment (size_t lo, size_t hi, const fsu::BitVector* base, std::string* out)
+  // writes " p" for every odd prime p in [lo, hi) to *out
+  {
+    std::ostringstream oss;
+    fsu::BitVector seg(segmentBits);
+    SieveSegment(lo, hi, *base, seg);
+    for (size_t j = seg.FindFirst(); j < seg.Size(); j = seg.FindNext(j))
+      oss << ' ' << lo + 2 * j;
+    *out = oss.str();
+  }
+
+  void AllPrimesBelow (size_t n, std::ostream& os, size_t threads)
+  // writes all primes <= n to os
+  // with threads > 1, that many consecutive segments are sieved concurrently
+  // and written in order
+  {
+    if (n >= 2)
+      os << ' ' << 2;
+    if (n >= 3)
+    {
+      if (threads == 0)
+	threads = 1;
+      fsu::BitVector base;
+      BasePrimes(ISqrt(n), base);
+      size_t hi = (n < n + 1) ? n + 1 : n;
+      std::string * out = new std::string [threads];
+      for (size_t lo = 3; lo < hi; )
+      {
+	std::thread * workers = new std::thread [threads];
+	size_t used = 0;
+	for ( ; used < threads && lo < hi; ++used)
+	{
+	  size_t segHi = (hi - lo > 2 * segmentBits) ? lo + 2 * segmentBits : hi;
+	  if (threads == 1)
+	    WriteSegment(lo, segHi, &base, &out[used]);
+	  else
+	    workers[used] = std::thread(WriteSegment, lo, segHi, &base, &out[used]);
+	  lo = segHi;
+	}
+	for (size_t t = 0; t < used; ++t)
+	{
+	  if (workers[t].joinable())
+	    workers[t].join();
+	  os << out[t];
+	}
+	delete [] workers;
+      }
+      delete [] out;
+    }
     os << std::endl;
   }
 
   void Sieve(BitVector& b)
   // pre:  b is a BitVector
-  // post: for all n < b.Size(), 
+  // post: for all n < b.Size(),
   //       n is prime iff 1 = b.Test(n)
   {
     const size_t max = b.Size();
 
-    // initialize b
-    b.Set();
-    b.Unset(0);  // 0 is not prime
-    b.Unset(1);  // 1 is not prime
+    b.Unset();
+    if (max > 2)
+      b.Set(2);
+    if (max <= 3)
+      return;
+
+    fsu::BitVector base;
+    BasePrimes(ISqrt(max), base);
+    fsu::BitVector seg(segmentBits);
 
-    // clear bits at multiples of all primes < sqrt(max)
-    for (size_t i = 2; i*i < max; ++i)
-      if (b.Test(i)) // i is prime
-	for (size_t j = i + i; j < max; j+= i)  // clear all multiples of i
-	  b.Unset(j);
+    // sieve one cache-sized block of odd numbers at a time
+    for (size_t lo = 1; lo < max; lo += 2 * segmentBits)
+    {
+      size_t hi = (max - lo > 2 * segmentBits) ? lo + 2 * segmentBits : max;
+      SieveSegment(lo, hi, base, seg);
+      for (size_t j = seg.FindFirst(); j < seg.Size(); j = seg.FindNext(j))
+	b.Set(lo + 2 * j);
+    }
   }  // end sieve()
 
 } // namespace fsu
@@ -3,14 +3,23 @@
     Chris Lacher
 
     prototypes of functions: 
-    prime_below(n), prime_above(n), all_primes_below(n, os), and sieve (bv)
+    prime_below(n), prime_above(n), is_prime(n), all_primes_below(n, os),
+    and sieve (bv)
 
-    all use BitVectors, and the first three all call sieve(), an
-    implementation of the  Sieve of Eratosthenes (fast, memory intensive)
+    all_primes_below() and sieve() use BitVectors and a segmented, odd-only
+    Sieve of Eratosthenes: the sieve works on one 32 KB block at a time, so
+    memory use is O(sqrt(n)) plus one block rather than n bits
 
-    prime_below() is likely to be faster than prime_above(), because
-    the former uses a bitvector of size n, while the latter needs
-    a bitvector of size max_primes
+    prime_below() and prime_above() search outward from n with is_prime(),
+    a deterministic Miller-Rabin test, so they take microseconds for any
+    size_t and need no memory
+
+    primeLadder[] is a compile-time table of primes, entry i being the
+    smallest prime >= 2^(i+1). A table that sizes itself from the ladder
+    can store the ladder index and reduce hash values with
+    PrimeLadderMod(h, index), a switch whose every case divides by a
+    constant, which the compiler lowers to multiply-shift instead of a
+    hardware divide.
 
     Copyright 2009, R.C. Lacher
 */
@@ -26,14 +35,66 @@ namespace fsu
 
   size_t PrimeBelow (size_t n);
   // returns largest prime number <= n
-  // or zero if input is too large
+  // or zero if n < 2
 
   size_t PrimeAbove (size_t n);
   // returns smallest prime number >= n
-  // or zero if input is too large
+  // or zero if there is no such size_t
+
+  bool IsPrime (size_t n);
+  // returns true iff n is prime (deterministic for 64-bit size_t)
+
+  void AllPrimesBelow (size_t n, std::ostream& os = std::cout, size_t threads = 1);
+  // prints all primes <= n
+  // threads > 1 sieves that many blocks concurrently; output order is unchanged
+
+  constexpr size_t primeLadder [] =
+  {
+    2ULL, 5ULL, 11ULL, 17ULL, 37ULL, 67ULL, 131ULL, 257ULL, 521ULL, 1031ULL, 2053ULL, 4099ULL,
+    8209ULL, 16411ULL, 32771ULL, 65537ULL, 131101ULL, 262147ULL, 524309ULL, 1048583ULL,
+    2097169ULL, 4194319ULL, 8388617ULL, 16777259ULL, 33554467ULL, 67108879ULL, 134217757ULL,
+    268435459ULL, 536870923ULL, 1073741827ULL, 2147483659ULL, 4294967311ULL, 8589934609ULL,
+    17179869209ULL, 34359738421ULL, 68719476767ULL, 137438953481ULL, 274877906951ULL,
+    549755813911ULL, 1099511627791ULL, 2199023255579ULL, 4398046511119ULL, 8796093022237ULL,
+    17592186044423ULL, 35184372088891ULL, 70368744177679ULL, 140737488355333ULL,
+    281474976710677ULL, 562949953421381ULL, 1125899906842679ULL, 2251799813685269ULL,
+    4503599627370517ULL, 9007199254740997ULL, 18014398509482143ULL, 36028797018963971ULL,
+    72057594037928017ULL, 144115188075855881ULL, 288230376151711813ULL, 576460752303423619ULL,
+    1152921504606847009ULL, 2305843009213693967ULL, 4611686018427388039ULL,
+    9223372036854775837ULL
+  } ;
+  constexpr size_t primeLadderSize = sizeof(primeLadder) / sizeof(primeLadder[0]);
+
+  size_t PrimeLadderIndex (size_t n);
+  // returns index of the smallest ladder prime >= n,
+  // or primeLadderSize - 1 if n exceeds the whole ladder
 
-  void AllPrimesBelow (size_t n, std::ostream& os = std::cout);
-  // prints all primes less than n
+  inline size_t PrimeLadderMod (size_t h, size_t index)
+  // returns h % primeLadder[index], dividing by a compile-time constant
+  {
+#define FSU_LADDER_CASE(i) case i: return h % primeLadder[i];
+    switch (index)
+    {
+      FSU_LADDER_CASE(0) FSU_LADDER_CASE(1) FSU_LADDER_CASE(2) FSU_LADDER_CASE(3)
+      FSU_LADDER_CASE(4) FSU_LADDER_CASE(5) FSU_LADDER_CASE(6) FSU_LADDER_CASE(7)
+      FSU_LADDER_CASE(8) FSU_LADDER_CASE(9) FSU_LADDER_CASE(10) FSU_LADDER_CASE(11)
+      FSU_LADDER_CASE(12) FSU_LADDER_CASE(13) FSU_LADDER_CASE(14) FSU_LADDER_CASE(15)
+      FSU_LADDER_CASE(16) FSU_LADDER_CASE(17) FSU_LADDER_CASE(18) FSU_LADDER_CASE(19)
+      FSU_LADDER_CASE(20) FSU_LADDER_CASE(21) FSU_LADDER_CASE(22) FSU_LADDER_CASE(23)
+      FSU_LADDER_CASE(24) FSU_LADDER_CASE(25) FSU_LADDER_CASE(26) FSU_LADDER_CASE(27)
+      FSU_LADDER_CASE(28) FSU_LADDER_CASE(29) FSU_LADDER_CASE(30) FSU_LADDER_CASE(31)
+      FSU_LADDER_CASE(32) FSU_LADDER_CASE(33) FSU_LADDER_CASE(34) FSU_LADDER_CASE(35)
+      FSU_LADDER_CASE(36) FSU_LADDER_CASE(37) FSU_LADDER_CASE(38) FSU_LADDER_CASE(39)
+      FSU_LADDER_CASE(40) FSU_LADDER_CASE(41) FSU_LADDER_CASE(42) FSU_LADDER_CASE(43)
+      FSU_LADDER_CASE(44) FSU_LADDER_CASE(45) FSU_LADDER_CASE(46) FSU_LADDER_CASE(47)
+      FSU_LADDER_CASE(48) FSU_LADDER_CASE(49) FSU_LADDER_CASE(50) FSU_LADDER_CASE(51)
+      FSU_LADDER_CASE(52) FSU_LADDER_CASE(53) FSU_LADDER_CASE(54) FSU_LADDER_CASE(55)
+      FSU_LADDER_CASE(56) FSU_LADDER_CASE(57) FSU_LADDER_CASE(58) FSU_LADDER_CASE(59)
+      FSU_LADDER_CASE(60) FSU_LADDER_CASE(61) FSU_LADDER_CASE(62)
+      default: return h % primeLadder[primeLadderSize - 1]; // out of range: top rung
+    }
+#undef FSU_LADDER_CASE
+  }
 
   void Sieve (fsu::BitVector& b);
   // The Sieve of Eratosthenes
@@ -5,35 +5,411 @@
 
     creates random <string, int> data for testing of tables
 
+    Fast mode (--fast, implied by --seed or --threads) replaces the
+    Random_String stream with a counter-based generator: every value of
+    record i is a SplitMix64 hash of (seed, i, word), so records can be
+    generated in any order, by any number of threads, and the file is the
+    same for a given seed regardless of thread count. Threads fill large
+    text buffers for consecutive blocks of records, which are written in
+    order with one write() per block.
+
+    Fast mode also offers skewed and adversarial key sets (--dist) for
+    worst-case chain lengths: Zipfian repeats, sequential and shared-prefix
+    keys, and anagrams with a shared suffix (collide under order-insensitive
+    or suffix-only hashes). Data is always the key length.
+
+    --binary writes the length-prefixed record format of tblfmt.h instead
+    of text (fast mode only). Its header carries the record count and key
+    length statistics, so loaders can size their tables before inserting.
+    The file ends with a sync index of the offset of every block, so a
+    parallel loader can cut it into chunks without walking the records.
+
     Copyright 2011, R.C. Lacher
 */
 
 #include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <stdint.h>
+#include <cmath>
+
+#include <tblfmt.h>
 
 #include <xstring.cpp>
 #include <xran.cpp>
 #include <xranxstr.cpp>
 
+static const size_t blockRecords = 65536;  // records per generation block
+
+inline uint64_t SplitMix64 (uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// word w of record i: the counter-based stream
+inline uint64_t RecordWord (uint64_t seed, uint64_t i, uint64_t w)
+{
+  return SplitMix64(SplitMix64(seed ^ (i * 0xD1B54A32D192ED03ULL)) + w);
+}
+
+// value in [0, n) from 16 random bits (multiply-shift, no division)
+inline size_t Range16 (uint64_t bits, size_t n)
+{
+  return (size_t)(((bits & 0xFFFF) * n) >> 16);
+}
+
+static const char   alphabet []  = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const size_t alphabetSize = sizeof(alphabet) - 1;
+
+// key distributions for fast mode
+enum Distribution
+{
+  uniform,     // independent random keys, lengths uniform in [min, max]
+  zipf,        // keys drawn from a universe of random keys with Zipf(skew) popularity
+  sequential,  // "user" + zero-padded record number
+  trailing,    // one shared prefix, keys differ only in their last characters
+  collide      // permutations of one letter set + one shared 6-char suffix
+} ;
+
+struct KeySpec
+{
+  Distribution dist;
+  uint64_t     seed;
+  size_t       num, min, max;    // max is one past the largest length
+  size_t       universe;         // zipf: number of distinct keys
+  double       skew;             // zipf: exponent
+  double *     zipfCdf;          // zipf: cumulative popularity of ranks 0 .. universe-1
+  size_t       digits;           // sequential, trailing, collide: variable part length
+  bool         binary;           // tblfmt.h records instead of text
+} ;
+
+// key length statistics of one block, for the binary header
+struct KeyStats
+{
+  uint64_t     bytes;
+  size_t       min, max;
+} ;
+
+// appends random key number i of length in [min, max) to out; returns its length
+size_t RandomKey (uint64_t seed, size_t i, size_t min, size_t max, std::string* out)
+{
+  uint64_t r = RecordWord(seed, i, 0);
+  size_t len = min + (size_t)(((r >> 32) * (uint64_t)(max - min)) >> 32);
+  // 4 characters from each 64-bit word
+  for (size_t c = 0, w = 1; c < len; ++w)
+  {
+    uint64_t bits = RecordWord(seed, i, w);
+    for (size_t k = 0; k < 4 && c < len; ++k, ++c, bits >>= 16)
+      out->push_back(alphabet[Range16(bits, alphabetSize)]);
+  }
+  return len;
+}
+
+// appends the key of record i to out; returns its length
+size_t AppendKey (const KeySpec& spec, size_t i, std::string* out)
+{
+  switch (spec.dist)
+  {
+    case zipf:
+    {
+      // inverse CDF: smallest rank whose cumulative popularity exceeds u
+      double u = (RecordWord(spec.seed, i, 0) >> 11) * (1.0 / 9007199254740992.0);
+      size_t lo = 0, hi = spec.universe - 1;
+      while (lo < hi)
+      {
+        size_t mid = (lo + hi) / 2;
+        if (spec.zipfCdf[mid] <= u)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      return RandomKey(spec.seed ^ 0x5A5A5A5A5A5A5A5AULL, lo, spec.min, spec.max, out);
+    }
+    case sequential:
+    {
+      out->append("user");
+      size_t start = out->size();
+      out->append(spec.digits, '0');
+      for (size_t v = i, c = out->size(); v > 0 && c > start; v /= 10)
+        (*out)[--c] = '0' + v % 10;
+      return 4 + spec.digits;
+    }
+    case trailing:
+    {
+      size_t prefix = spec.max - 1 - spec.digits;
+      RandomKey(spec.seed, (size_t)-1, prefix, prefix + 1, out); // the same for every record
+      size_t start = out->size();
+      out->append(spec.digits, alphabet[0]);
+      for (size_t v = i, c = out->size(); v > 0 && c > start; v /= alphabetSize)
+        (*out)[--c] = alphabet[v % alphabetSize];
+      return prefix + spec.digits;
+    }
+    case collide:
+    {
+      // permutation number i of the first spec.digits letters (factorial number system)
+      char letters [32];
+      for (size_t c = 0; c < spec.digits; ++c)
+        letters[c] = alphabet[c];
+      size_t v = i;
+      for (size_t left = spec.digits; left > 0; --left)
+      {
+        size_t pick = v % left;
+        v /= left;
+        out->push_back(letters[pick]);
+        letters[pick] = letters[left - 1];
+      }
+      out->append("zZzZzZ");
+      return spec.digits + 6;
+    }
+    case uniform:
+    default:
+      return RandomKey(spec.seed, i, spec.min, spec.max, out);
+  }
+}
+
+// appends the text or binary records [first, first + count) to out
+void GenerateBlock (const KeySpec* spec, size_t first, size_t count, std::string* out, KeyStats* stats)
+{
+  char record [32];
+  out->clear();
+  out->reserve(count * (spec->max + 8));
+  stats->bytes = 0;
+  stats->min   = (size_t)-1;
+  stats->max   = 0;
+  for (size_t i = first; i < first + count; ++i)
+  {
+    size_t start = out->size();
+    if (spec->binary)
+      out->append(4, '\0');  // length prefix, filled in below
+    size_t len = AppendKey(*spec, i, out);
+    stats->bytes += len;
+    if (len < stats->min) stats->min = len;
+    if (len > stats->max) stats->max = len;
+    if (spec->binary)
+    {
+      fsu::tblfmt::Put32(&(*out)[start], (uint32_t)len);
+      fsu::tblfmt::Put32(record, (uint32_t)len);
+      out->append(record, fsu::tblfmt::dataWidth);
+      continue;
+    }
+    // '\t' << len << '\n'
+    size_t n = sizeof(record);
+    record[--n] = '\n';
+    size_t v = len;
+    do { record[--n] = '0' + v % 10; v /= 10; } while (v > 0);
+    record[--n] = '\t';
+    out->append(record + n, sizeof(record) - n);
+  }
+}
+
+// fast mode: blocks of records generated by threads, written in order
+// binary output is preceded by its header, rewritten once the key stats are known,
+// and followed by a sync index holding the file offset of every block
+void GenerateFast (std::ofstream& out1, const KeySpec& spec, size_t threads)
+{
+  if (threads == 0) threads = 1;
+  const size_t num = spec.num;
+  char header [fsu::tblfmt::headerSize];
+  fsu::tblfmt::Header h;
+  h.records   = num;
+  h.keyBytes  = 0;
+  h.minKey    = num > 0 ? (uint32_t)-1 : 0;
+  h.maxKey    = 0;
+  h.dataWidth = fsu::tblfmt::dataWidth;
+  h.flags     = spec.binary ? fsu::tblfmt::flagIndex : 0;
+  std::vector < uint64_t > sync;   // file offset of each block
+  uint64_t offset = fsu::tblfmt::headerSize;
+  if (spec.binary)
+  {
+    fsu::tblfmt::WriteHeader(header, h);
+    out1.write(header, sizeof(header));
+  }
+  std::string * buffers = new std::string [threads];
+  KeyStats * stats = new KeyStats [threads];
+  for (size_t first = 0; first < num; )
+  {
+    std::thread * workers = new std::thread [threads];
+    size_t used = 0;
+    for ( ; used < threads && first < num; ++used)
+    {
+      size_t count = (num - first < blockRecords) ? num - first : blockRecords;
+      if (threads == 1)
+        GenerateBlock(&spec, first, count, &buffers[used], &stats[used]);
+      else
+        workers[used] = std::thread(GenerateBlock, &spec, first, count, &buffers[used], &stats[used]);
+      first += count;
+    }
+    for (size_t t = 0; t < used; ++t)
+    {
+      if (workers[t].joinable())
+        workers[t].join();
+      sync.push_back(offset);
+      offset += buffers[t].size();
+      out1.write(buffers[t].data(), buffers[t].size());
+      h.keyBytes += stats[t].bytes;
+      if (stats[t].min < h.minKey) h.minKey = (uint32_t)stats[t].min;
+      if (stats[t].max > h.maxKey) h.maxKey = (uint32_t)stats[t].max;
+    }
+    delete [] workers;
+  }
+  if (spec.binary)
+  {
+    std::string index (8 * sync.size() + fsu::tblfmt::trailerSize, '\0');
+    fsu::tblfmt::PutIndex(&index[0], sync.empty() ? 0 : &sync[0], sync.size());
+    out1.write(index.data(), index.size());
+    fsu::tblfmt::WriteHeader(header, h);
+    out1.seekp(0);
+    out1.write(header, sizeof(header));
+  }
+  delete [] stats;
+  delete [] buffers;
+}
+
+// completes spec for its distribution; false if the parameters cannot work
+bool PrepareSpec (KeySpec& spec)
+{
+  spec.zipfCdf = 0;
+  spec.digits  = 1;
+  switch (spec.dist)
+  {
+    case zipf:
+    {
+      if (spec.universe == 0)
+        spec.universe = spec.num / 10 + 1;
+      spec.zipfCdf = new double [spec.universe];
+      double sum = 0;
+      for (size_t r = 0; r < spec.universe; ++r)
+        spec.zipfCdf[r] = (sum += pow(r + 1.0, -spec.skew));
+      for (size_t r = 0; r < spec.universe; ++r)
+        spec.zipfCdf[r] /= sum;
+      return 1;
+    }
+    case sequential:
+      for (size_t v = spec.num; v >= 10; v /= 10)
+        ++spec.digits;
+      if (spec.min > 4 + spec.digits)
+        spec.digits = spec.min - 4;
+      return 1;
+    case trailing:
+      for (size_t v = spec.num; v >= alphabetSize; v /= alphabetSize)
+        ++spec.digits;
+      if (spec.max - 1 <= spec.digits)
+        spec.max = spec.digits + 2;  // room for a prefix of at least one character
+      return 1;
+    case collide:
+    {
+      // smallest letter set with at least num permutations
+      size_t perms = 1;
+      spec.digits = 0;
+      while (perms < spec.num)
+      {
+        ++spec.digits;
+        if (perms > (size_t)-1 / spec.digits || spec.digits > 20)
+          return 0;
+        perms *= spec.digits;
+      }
+      if (spec.digits < 2)
+        spec.digits = 2;
+      return 1;
+    }
+    case uniform:
+    default:
+      return 1;
+  }
+}
+
+void Usage ()
+{
+  std::cout << " ** program requires 4 arguments\n"
+            << "    1 = number of generated entries\n"
+            << "    2 = min size of string key\n"
+            << "    3 = max size of string key\n"
+            << "    4 = output filename\n"
+            << "    options (before the arguments):\n"
+            << "    --fast       = counter-based generator, buffered parallel output\n"
+            << "    --binary     = length-prefixed binary records (tblfmt.h), implies --fast\n"
+            << "    --seed n     = seed for fast mode (default 1)\n"
+            << "    --threads n  = generator threads for fast mode (default hardware threads)\n"
+            << "    --dist d     = key distribution for fast mode:\n"
+            << "                   uniform     random keys (default)\n"
+            << "                   zipf        repeated keys with Zipfian popularity\n"
+            << "                   sequential  user000001, user000002, ...\n"
+            << "                   trailing    shared prefix, keys differ in the last characters\n"
+            << "                   collide     anagrams with a shared suffix (collide under\n"
+            << "                               order-insensitive / suffix-only hashes)\n"
+            << "    --skew s     = zipf exponent (default 1.0)\n"
+            << "    --universe n = zipf distinct keys (default entries / 10 + 1)\n"
+            << " ** try again\n";
+  exit(0);
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc != 5)
+  // options
+  bool fast = 0;
+  KeySpec spec;
+  spec.dist = uniform;
+  spec.seed = 1;
+  spec.universe = 0;
+  spec.skew = 1.0;
+  spec.binary = 0;
+  size_t threads = std::thread::hardware_concurrency();
+  int a = 1;
+  while (a < argc && argv[a][0] == '-' && argv[a][1] == '-')
   {
-    std::cout << " ** program requires 4 arguments\n"
-	      << "    1 = number of generated entries\n"
-	      << "    2 = min size of string key\n"
-	      << "    3 = max size of string key\n"
-	      << "    4 = output filename\n"
-	      << " ** try again\n";
-    exit(0);
+    fsu::String option(argv[a]);
+    if (option == "--fast" || option == "--binary")
+    {
+      fast = 1;
+      if (option == "--binary") spec.binary = 1;
+      a += 1;
+      continue;
+    }
+    if (a + 1 >= argc)
+      Usage();
+    fsu::String value(argv[a+1]);
+    if (option == "--seed")
+      spec.seed = strtoull(argv[a+1], 0, 10);
+    else if (option == "--skew")
+      spec.skew = atof(argv[a+1]);
+    else if (option == "--universe")
+      spec.universe = strtoull(argv[a+1], 0, 10);
+    else if (option == "--dist")
+    {
+      if      (value == "uniform")    spec.dist = uniform;
+      else if (value == "zipf")       spec.dist = zipf;
+      else if (value == "sequential") spec.dist = sequential;
+      else if (value == "trailing")   spec.dist = trailing;
+      else if (value == "collide")    spec.dist = collide;
+      else Usage();
+    }
+    else if (option == "--threads")
+      threads = atoi(argv[a+1]);
+    else
+      Usage();
+    fast = 1;
+    a += 2;
   }
+  argc -= a - 1;
+  argv += a - 1;
+  if (argc != 5)
+    Usage();
 
-  std::cout << "Program generating file of TAB-seperated <key,data> entries:\n"
+  std::cout << "Program generating file of " << (spec.binary ? "binary" : "TAB-seperated")
+	    << " <key,data> entries:\n"
 	    << " key = string of size in [" << argv[2] << ',' << argv[3] << "]\n"
 	    << " data = integer (length of string key)\n"
 	    << " ...\n";
 
   std::ofstream out1;
-  out1.open(argv[4]);
+  if (spec.binary)
+    out1.open(argv[4], std::ios::out | std::ios::binary);
+  else
+    out1.open(argv[4]);
   if (out1.fail())
   {
     std::cout << " ** Unable to open file " << argv[4] << '\n'
@@ -41,13 +417,30 @@ int main(int argc, char* argv[])
     exit(0);
   }
 
-  fsu::Random_String ranString;
-  fsu::Random_int ranint;
   size_t num = atoi(argv[1]), min = atoi(argv[2]), max = atoi(argv[3]) + 1, len;
-  for (size_t i = 0; i < num; ++i)
+  if (fast)
+  {
+    spec.num = num;
+    spec.min = min;
+    spec.max = max;
+    if (!PrepareSpec(spec))
+    {
+      std::cout << " ** too many entries for --dist collide\n"
+                << " ** program closing\n";
+      exit(0);
+    }
+    GenerateFast(out1, spec, threads);
+    delete [] spec.zipfCdf;
+  }
+  else
   {
-    len = ranint(min, max);
-    out1 << ranString(len) << '\t' << len << '\n';
+    fsu::Random_String ranString;
+    fsu::Random_int ranint;
+    for (size_t i = 0; i < num; ++i)
+    {
+      len = ranint(min, max);
+      out1 << ranString(len) << '\t' << len << '\n';
+    }
   }
 
   // close outfile
@@ -0,0 +1,403 @@
+/*
+    taskpool.h
+
+    TaskPool  - work-stealing task scheduler
+    TaskGroup - completion count of a set of spawned tasks
+
+    Each worker thread owns a Chase-Lev deque of tasks. A worker pushes the
+    tasks it spawns at the bottom of its own deque and pops from the bottom
+    (newest first, still in cache); idle workers steal from the top of a
+    victim's deque (oldest first, which in a divide and conquer split is
+    the largest piece). Tasks spawned by threads outside the pool go to a
+    shared LockFreeQueue (lfqueue.h) that every worker polls.
+
+    Wait(group) does not block: the waiting thread runs queued tasks (its
+    own, injected, or stolen) until the group count reaches zero, so tasks
+    may spawn and wait on nested groups, and a pool with no workers still
+    completes everything on the waiting thread.
+
+    ParallelFor(begin, end, grain, f) calls f(lo, hi) on pieces of
+    [begin, end) at most grain long. It halves the range, spawns the upper
+    half and continues with the lower one, so thieves take large pieces and
+    uneven pieces (long bucket chains, for instance) spread over the
+    workers as they finish.
+
+    Workers spin briefly when idle, then sleep on a condition variable until
+    a task is queued. A deque holds dequeCapacity tasks; Spawn runs the task
+    at once when the deque (or the injection queue) is full.
+
+    Shared() is the process-wide pool used by the HashTable parallel
+    operations: hardware_concurrency - 1 workers (the caller of Wait is the
+    last thread), or FSU_THREADS - 1 when that environment variable is set.
+*/
+
+#ifndef _TASKPOOL_H
+#define _TASKPOOL_H
+
+#include <cstdlib>
+#include <stdint.h>
+#include <functional>  // std::hash
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <lfqueue.h>
+
+namespace fsu
+{
+
+  class TaskPool;
+
+  class TaskGroup
+  {
+  public:
+    TaskGroup () : pending_(0) {}
+    bool Done () const { return pending_.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class TaskPool;
+    std::atomic<size_t> pending_;   // spawned and not yet finished
+
+    TaskGroup            (const TaskGroup&); // disallowed
+    TaskGroup& operator= (const TaskGroup&); // disallowed
+  } ;
+
+  namespace taskpool
+  {
+    static const size_t dequeCapacity  = 4096;  // power of 2
+    static const size_t injectCapacity = 4096;
+    static const size_t spinLimit      = 64;    // idle polls before a worker sleeps
+
+    struct Task
+    {
+      TaskGroup * group;
+      explicit Task (TaskGroup* g) : group(g) {}
+      virtual ~Task () {}
+      virtual void Run () = 0;
+    } ;
+
+    template < class F >
+    struct FunctionTask : public Task
+    {
+      F fn;
+      FunctionTask (TaskGroup* g, const F& f) : Task(g), fn(f) {}
+      void Run () { fn(); }
+    } ;
+
+    // Chase-Lev deque of fixed capacity: the owner pushes and pops at the
+    // bottom, any thread steals at the top
+    class Deque
+    {
+    public:
+      Deque () : top_(0), bottom_(0)
+      {
+        for (size_t i = 0; i < dequeCapacity; ++i)
+          slots_[i].store(0, std::memory_order_relaxed);
+      }
+
+      bool Push (Task* t)   // owner only; false iff full
+      {
+        long b = bottom_.load(std::memory_order_relaxed);
+        long t0 = top_.load(std::memory_order_acquire);
+        if (b - t0 >= (long)dequeCapacity)
+          return 0;
+        slots_[b & (dequeCapacity - 1)].store(t, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);
+        return 1;
+      }
+
+      Task* Pop ()          // owner only; 0 iff empty
+      {
+        long b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_seq_cst);
+        long t = top_.load(std::memory_order_seq_cst);
+        if (t > b)
+        {
+          bottom_.store(b + 1, std::memory_order_relaxed);
+          return 0;
+        }
+        Task* task = slots_[b & (dequeCapacity - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+          // last task: race the thieves for it
+          if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst))
+            task = 0;
+          bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+      }
+
+      Task* Steal ()        // any thread; 0 iff empty or another thread won the top task
+      {
+        long t = top_.load(std::memory_order_seq_cst);
+        long b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b)
+          return 0;
+        Task* task = slots_[t & (dequeCapacity - 1)].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst))
+          return 0;
+        return task;
+      }
+
+    private:
+      enum { cacheLine = 64 };
+      std::atomic<long>   top_;
+      char                pad0_ [cacheLine];
+      std::atomic<long>   bottom_;
+      char                pad1_ [cacheLine];
+      std::atomic<Task*>  slots_ [dequeCapacity];
+
+      Deque            (const Deque&); // disallowed
+      Deque& operator= (const Deque&); // disallowed
+    } ;
+
+    inline uint64_t NextRandom ()
+    // per-thread xorshift, for choosing steal victims
+    {
+      static thread_local uint64_t state = 0;
+      if (state == 0)
+        state = (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return state;
+    }
+  } // namespace taskpool
+
+  class TaskPool
+  {
+  public:
+    explicit TaskPool   (size_t workers);  // threads besides the callers of Wait
+             ~TaskPool  ();
+
+    size_t   Workers     () const;
+    size_t   Concurrency () const;         // Workers() + 1
+    size_t   Steals      () const;         // tasks taken from another worker's deque, so far
+
+    template < class F >
+    void     Spawn       (TaskGroup& group, const F& fn);   // fn() runs on some thread
+    void     Wait        (TaskGroup& group);                // runs tasks until group is done
+
+    // f(lo, hi) for pieces of [begin, end) at most grain long
+    template < class F >
+    void     ParallelFor (size_t begin, size_t end, size_t grain, const F& f);
+
+    static TaskPool& Shared ();
+
+  private:
+    struct Worker
+    {
+      taskpool::Deque  deque;
+      std::thread      thread;
+      TaskPool *       pool;
+    } ;
+
+    Worker *                             workers_;
+    size_t                               numWorkers_;
+    LockFreeQueue < taskpool::Task* >    inject_;    // tasks spawned outside the pool
+    std::atomic<size_t>                  queued_;    // tasks pushed and not yet taken
+    std::atomic<size_t>                  sleepers_;
+    std::atomic<size_t>                  steals_;
+    std::atomic<bool>                    stop_;
+    std::mutex                           mutex_;
+    std::condition_variable              wake_;
+
+    static Worker*& Current ();               // worker run by this thread, or 0
+    Worker*         Self    ();               // Current() if it belongs to this pool
+    taskpool::Task* Find    (Worker* self);
+    void            Execute (taskpool::Task* t);
+    void            Loop    (Worker* self);
+    template < class F >
+    void            Split   (TaskGroup& group, size_t lo, size_t hi, size_t grain, const F& f);
+
+    TaskPool            (const TaskPool&); // disallowed
+    TaskPool& operator= (const TaskPool&); // disallowed
+  } ;
+
+  inline TaskPool::TaskPool (size_t workers)
+    : workers_(0), numWorkers_(workers), inject_(taskpool::injectCapacity),
+      queued_(0), sleepers_(0), steals_(0), stop_(0)
+  {
+    if (numWorkers_ > 0)
+      workers_ = new Worker [numWorkers_];
+    for (size_t i = 0; i < numWorkers_; ++i)
+    {
+      workers_[i].pool = this;
+      workers_[i].thread = std::thread(&TaskPool::Loop, this, &workers_[i]);
+    }
+  }
+
+  inline TaskPool::~TaskPool ()
+  {
+    stop_.store(1);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < numWorkers_; ++i)
+      workers_[i].thread.join();
+    delete [] workers_;
+  }
+
+  inline size_t TaskPool::Workers () const
+  {
+    return numWorkers_;
+  }
+
+  inline size_t TaskPool::Concurrency () const
+  {
+    return numWorkers_ + 1;
+  }
+
+  inline size_t TaskPool::Steals () const
+  {
+    return steals_.load(std::memory_order_relaxed);
+  }
+
+  inline TaskPool& TaskPool::Shared ()
+  {
+    static TaskPool pool (
+      [] () -> size_t
+      {
+        size_t n = std::thread::hardware_concurrency();
+        const char* env = std::getenv("FSU_THREADS");
+        if (env && std::atoi(env) > 0)
+          n = (size_t)std::atoi(env);
+        return n > 1 ? n - 1 : 0;
+      } ());
+    return pool;
+  }
+
+  inline TaskPool::Worker*& TaskPool::Current ()
+  {
+    static thread_local Worker* current = 0;
+    return current;
+  }
+
+  inline TaskPool::Worker* TaskPool::Self ()
+  {
+    Worker* w = Current();
+    return (w && w->pool == this) ? w : 0;
+  }
+
+  template < class F >
+  void TaskPool::Spawn (TaskGroup& group, const F& fn)
+  {
+    group.pending_.fetch_add(1, std::memory_order_relaxed);
+    taskpool::Task* t = new taskpool::FunctionTask<F>(&group, fn);
+    Worker* self = Self();
+    queued_.fetch_add(1);
+    if (!(self ? self->deque.Push(t) : inject_.Push(t)))
+    {
+      queued_.fetch_sub(1);
+      Execute(t);   // full: run it now
+      return;
+    }
+    if (sleepers_.load() > 0)
+    {
+      // a sleeper checked queued_ under mutex_ before waiting, so taking the
+      // lock here guarantees it is either awake or waiting on wake_
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+      }
+      wake_.notify_one();
+    }
+  }
+
+  inline taskpool::Task* TaskPool::Find (Worker* self)
+  {
+    taskpool::Task* t = 0;
+    if (self)
+      t = self->deque.Pop();
+    if (t == 0)
+      inject_.Pop(t);
+    if (t == 0 && numWorkers_ > 0)
+    {
+      size_t start = (size_t)(taskpool::NextRandom() % numWorkers_);
+      for (size_t i = 0; i < numWorkers_ && t == 0; ++i)
+      {
+        Worker& victim = workers_[(start + i) % numWorkers_];
+        if (&victim != self && (t = victim.deque.Steal()) != 0)
+          steals_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (t)
+      queued_.fetch_sub(1);
+    return t;
+  }
+
+  inline void TaskPool::Execute (taskpool::Task* t)
+  {
+    TaskGroup* group = t->group;
+    t->Run();
+    delete t;
+    group->pending_.fetch_sub(1, std::memory_order_release);
+  }
+
+  inline void TaskPool::Wait (TaskGroup& group)
+  {
+    Worker* self = Self();
+    while (!group.Done())
+    {
+      taskpool::Task* t = Find(self);
+      if (t)
+        Execute(t);
+      else
+        std::this_thread::yield();  // remaining tasks are running elsewhere
+    }
+  }
+
+  inline void TaskPool::Loop (Worker* self)
+  {
+    Current() = self;
+    size_t idle = 0;
+    while (!stop_.load())
+    {
+      taskpool::Task* t = Find(self);
+      if (t)
+      {
+        Execute(t);
+        idle = 0;
+        continue;
+      }
+      if (++idle < taskpool::spinLimit)
+      {
+        std::this_thread::yield();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      sleepers_.fetch_add(1);
+      while (queued_.load() == 0 && !stop_.load())
+        wake_.wait(lock);
+      sleepers_.fetch_sub(1);
+      idle = 0;
+    }
+    Current() = 0;
+  }
+
+  template < class F >
+  void TaskPool::ParallelFor (size_t begin, size_t end, size_t grain, const F& f)
+  {
+    if (grain == 0)
+      grain = 1;
+    TaskGroup group;
+    Split(group, begin, end, grain, f);
+    Wait(group);
+  }
+
+  template < class F >
+  void TaskPool::Split (TaskGroup& group, size_t lo, size_t hi, size_t grain, const F& f)
+  {
+    while (hi - lo > grain)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      Spawn(group, [this, &group, mid, hi, grain, &f] () { Split(group, mid, hi, grain, f); });
+      hi = mid;
+    }
+    if (lo < hi)
+      f(lo, hi);
+  }
+
+} // namespace fsu
+
+#endif
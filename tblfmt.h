@@ -0,0 +1,223 @@
+/*
+    tblfmt.h
+
+    Binary table record format
+
+    A binary table file is a 40-byte header followed by records:
+
+      header   offset  size
+               0       8     magic "FSUTBL01"
+               8       8     record count
+               16      8     total key bytes
+               24      4     min key length
+               28      4     max key length
+               32      4     data width in bytes (4)
+               36      4     flags: bit 0 (flagIndex) = sync index at end
+
+      record   4             key length n
+               n             key characters (no terminator)
+               4             data, two's complement
+
+      sync index (only with flagIndex), after the last record:
+               8 * m         file offsets of m record boundaries, ascending
+               8             m
+               8             magic "FSUIDX01"
+
+    All integers are little-endian and written byte by byte, so files are
+    portable between hosts. The header's record count lets a loader size
+    its table before the first insert.
+
+    A record boundary cannot be found from an arbitrary byte, so the sync
+    index (rantable writes one entry per 65536 records) lets a parallel
+    loader cut the file into chunks by binary search instead of stepping
+    over every length prefix first. Scanners stop at RecordsEnd(), the
+    start of the index. Files written with flags 0 have no index and
+    their records run to the end of the file.
+
+    Nothing read from a file is trusted for sizing: RecordCount() caps
+    the header's record count at what the record region can hold (a
+    record is at least 8 bytes), and CheckIndex() confirms that the sync
+    offsets increase and lie in the record region before they are used
+    as cut points.
+*/
+
+#ifndef _TBLFMT_H
+#define _TBLFMT_H
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+namespace fsu
+{
+
+  namespace tblfmt
+  {
+    static const char   magic []     = "FSUTBL01";
+    static const size_t magicSize    = 8;
+    static const size_t headerSize   = 40;
+    static const size_t dataWidth    = 4;
+    static const char   indexMagic [] = "FSUIDX01";
+    static const size_t trailerSize  = 16;   // index count and magic
+    static const uint32_t flagIndex  = 1;
+
+    struct Header
+    {
+      uint64_t records;
+      uint64_t keyBytes;
+      uint32_t minKey;
+      uint32_t maxKey;
+      uint32_t dataWidth;
+      uint32_t flags;
+    } ;
+
+    inline void Put32 (char* p, uint32_t v)
+    {
+      for (int i = 0; i < 4; ++i, v >>= 8)
+        p[i] = (char)(v & 0xFF);
+    }
+
+    inline void Put64 (char* p, uint64_t v)
+    {
+      for (int i = 0; i < 8; ++i, v >>= 8)
+        p[i] = (char)(v & 0xFF);
+    }
+
+    inline uint32_t Get32 (const char* p)
+    {
+      uint32_t v = 0;
+      for (int i = 3; i >= 0; --i)
+        v = (v << 8) | (unsigned char)p[i];
+      return v;
+    }
+
+    inline uint64_t Get64 (const char* p)
+    {
+      uint64_t v = 0;
+      for (int i = 7; i >= 0; --i)
+        v = (v << 8) | (unsigned char)p[i];
+      return v;
+    }
+
+    // fills buffer[0 .. headerSize)
+    inline void WriteHeader (char* buffer, const Header& h)
+    {
+      memset(buffer, 0, headerSize);
+      memcpy(buffer, magic, magicSize);
+      Put64(buffer + 8,  h.records);
+      Put64(buffer + 16, h.keyBytes);
+      Put32(buffer + 24, h.minKey);
+      Put32(buffer + 28, h.maxKey);
+      Put32(buffer + 32, h.dataWidth);
+      Put32(buffer + 36, h.flags);
+    }
+
+    // true iff [p, p + size) starts with a binary table header
+    inline bool IsBinary (const char* p, size_t size)
+    {
+      return size >= headerSize && 0 == memcmp(p, magic, magicSize);
+    }
+
+    inline Header ReadHeader (const char* p)
+    {
+      Header h;
+      h.records   = Get64(p + 8);
+      h.keyBytes  = Get64(p + 16);
+      h.minKey    = Get32(p + 24);
+      h.maxKey    = Get32(p + 28);
+      h.dataWidth = Get32(p + 32);
+      h.flags     = Get32(p + 36);
+      return h;
+    }
+
+    // appends the sync index for boundaries offset[0 .. m) at p; returns position after it
+    inline char* PutIndex (char* p, const uint64_t* offset, size_t m)
+    {
+      for (size_t j = 0; j < m; ++j, p += 8)
+        Put64(p, offset[j]);
+      Put64(p, m);
+      memcpy(p + 8, indexMagic, magicSize);
+      return p + trailerSize;
+    }
+
+    // locates the sync index of the binary file image [p, p + size):
+    // false if there is none (or it is damaged); else count boundaries start at index
+    inline bool FindIndex (const char* p, size_t size, const char*& index, size_t& count)
+    {
+      if (size < headerSize + trailerSize || !(Get32(p + 36) & flagIndex)
+          || 0 != memcmp(p + size - magicSize, indexMagic, magicSize))
+        return 0;
+      uint64_t m = Get64(p + size - trailerSize);
+      if (m > (size - headerSize - trailerSize) / 8)
+        return 0;
+      count = (size_t)m;
+      index = p + size - trailerSize - 8 * count;
+      return 1;
+    }
+
+    // end of the records of the binary file image [p, p + size)
+    inline const char* RecordsEnd (const char* p, size_t size)
+    {
+      const char * index;
+      size_t count;
+      return FindIndex(p, size, index, count) ? index : p + size;
+    }
+
+    // the header's record count, capped at the records [p, p + size) can hold
+    inline uint64_t RecordCount (const char* p, size_t size)
+    {
+      uint64_t records = ReadHeader(p).records;
+      uint64_t room = (uint64_t)(RecordsEnd(p, size) - (p + headerSize)) / 8;
+      return (records < room) ? records : room;
+    }
+
+    // file offset of sync point j, 0 <= j < count
+    inline uint64_t IndexEntry (const char* index, size_t j)
+    {
+      return Get64(index + 8 * j);
+    }
+
+    // true iff the sync points found by FindIndex increase and lie in the
+    // record region [headerSize, index - p); otherwise they must not be used
+    inline bool CheckIndex (const char* p, const char* index, size_t count)
+    {
+      uint64_t low = headerSize;
+      const uint64_t end = (uint64_t)(index - p);
+      for (size_t j = 0; j < count; ++j)
+      {
+        uint64_t offset = IndexEntry(index, j);
+        if (offset < low || offset >= end)
+          return 0;
+        low = offset + 1;
+      }
+      return 1;
+    }
+
+    // position after the record at p, or 0 if it runs past e
+    inline const char* NextRecord (const char* p, const char* e)
+    {
+      if (e - p < 8)
+        return 0;
+      uint32_t klen = Get32(p);
+      if ((size_t)(e - p) < 8 + (size_t)klen)
+        return 0;
+      return p + 8 + klen;
+    }
+
+    // calls sink(key, keyLength, data) for each complete record in [p, e)
+    template < class S >
+    void ScanBinary (const char* p, const char* e, S& sink)
+    {
+      const char * q;
+      while ((q = NextRecord(p, e)) != 0)
+      {
+        uint32_t klen = Get32(p);
+        sink(p + 4, (size_t)klen, (long long)(int32_t)Get32(p + 4 + klen));
+        p = q;
+      }
+    }
+  } // namespace tblfmt
+
+} // namespace fsu
+
+#endif
@@ -0,0 +1,264 @@
+/*
+    tblload.h
+
+    LoadTable (filename, table, count, presize)
+
+    Loads a file of <key, data> records, as written by rantable, into any
+    table T with
+
+      T::KeyType       constructible from const char*
+      T::DataType      an integer type
+      T::Insert(b, e)  bulk insert of a range of Pair<KeyType, DataType>
+      T::Reserve(n)    pre-size for n records (used only when presize)
+
+    Two file formats are accepted and told apart by the first bytes:
+    whitespace-separated text, and the length-prefixed binary format of
+    tblfmt.h. Binary files are scanned without tokenizing or number
+    parsing, and their header gives the record count up front, so with
+    presize = true the table is sized once before the first insert
+    instead of being loaded at whatever bucket count it was built with.
+
+    The file is mapped with MappedFile and scanned by hand: no iostream,
+    no locale, no per-token stream state. Records are collected in batches
+    of batchSize pairs and handed to the table's bulk insert path.
+
+    Keys are not zero-copy. T::KeyType is only assumed to have a
+    K(const char*) constructor, so each key is copied into a reused
+    terminated buffer, built as one temporary K and assigned into its batch
+    Pair. The table then copies it into its Entry. The saving is the stream
+    machinery (extraction, locale, eof handling), not the per-key K.
+    A trailing partial record (a key with no data) is ignored, so the
+    last record is never duplicated at end of file. A record whose data
+    token is not wholly a decimal integer is dropped; a data value out of
+    the range of T::DataType is saturated to it (tblload::ToData).
+
+    Returns false if the file cannot be opened; count is the number of
+    records inserted. A binary file whose header promises more records than
+    it holds loads the complete records only.
+
+    LoadTable (file, table, count, presize) loads from a MappedFile the
+    caller has already opened, and tblload::CountRecords (p, e) estimates
+    the records in a file image without parsing it: the header count of a
+    binary file, the number of lines of a text file (one memchr pass). A
+    caller whose table does not rehash by itself can size it first.
+*/
+
+#ifndef _TBLLOAD_H
+#define _TBLLOAD_H
+
+#include <cstdlib>
+#include <cstring>   // memchr
+#include <limits>
+#include <pair.h>
+#include <vector.h>
+#include <mapfile.h>
+#include <tblfmt.h>
+
+namespace fsu
+{
+
+  namespace tblload
+  {
+    static const size_t batchSize = 4096;
+
+    inline bool IsSpace (char c)
+    {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // advance p past whitespace; returns p (== e at end of input)
+    inline const char* SkipSpace (const char* p, const char* e)
+    {
+      while (p != e && IsSpace(*p))
+        ++p;
+      return p;
+    }
+
+    // parse optionally signed decimal at p, saturated to the range of long long;
+    // returns position after the number, or p itself if there are no digits
+    inline const char* ParseInteger (const char* p, const char* e, long long& value)
+    {
+      const char * s = p;
+      bool negative = 0;
+      if (p != e && (*p == '-' || *p == '+'))
+      {
+        negative = (*p == '-');
+        ++p;
+      }
+      if (p == e || *p < '0' || *p > '9')
+        return s;
+      const unsigned long long limit = negative
+        ? (unsigned long long)std::numeric_limits<long long>::max() + 1
+        : (unsigned long long)std::numeric_limits<long long>::max();
+      unsigned long long v = 0;
+      while (p != e && *p >= '0' && *p <= '9')
+      {
+        unsigned digit = (unsigned)(*p++ - '0');
+        v = (v > (limit - digit) / 10) ? limit : 10 * v + digit;
+      }
+      if (!negative)
+        value = (long long)v;
+      else if (v == limit)
+        value = std::numeric_limits<long long>::min();
+      else
+        value = -(long long)v;
+      return p;
+    }
+
+    // d saturated to the range of the integer type D
+    template < typename D >
+    D ToData (long long d)
+    {
+      if (std::numeric_limits<D>::is_signed)
+      {
+        if (d < (long long)std::numeric_limits<D>::min()) return std::numeric_limits<D>::min();
+        if (d > (long long)std::numeric_limits<D>::max()) return std::numeric_limits<D>::max();
+      }
+      else
+      {
+        if (d < 0) return 0;
+        if ((unsigned long long)d > (unsigned long long)std::numeric_limits<D>::max()) return std::numeric_limits<D>::max();
+      }
+      return (D)d;
+    }
+  } // namespace tblload
+
+  namespace tblload
+  {
+    // ScanRecords calls sink(key, keyLength, data) for each complete
+    // record in [p, e); key points into the input and is not terminated
+    template < class S >
+    void ScanRecords (const char* p, const char* e, S& sink)
+    {
+      while (1)
+      {
+        // key token
+        p = SkipSpace(p, e);
+        if (p == e) break;
+        const char * k = p;
+        while (p != e && !IsSpace(*p))
+          ++p;
+        size_t klen = p - k;
+
+        // data token
+        p = SkipSpace(p, e);
+        if (p == e) break;
+        long long d;
+        const char * q = ParseInteger(p, e, d);
+        if (q == p || (q != e && !IsSpace(*q))) // data is not a number: drop the record
+        {
+          while (p != e && !IsSpace(*p))
+            ++p;
+          continue;
+        }
+        p = q;
+        sink(k, klen, d);
+      }
+    }
+
+    // record count of a binary image (capped by its size), line count of a text image (an estimate:
+    // blank lines count, a record spread over several lines counts more than once)
+    inline size_t CountRecords (const char* p, const char* e)
+    {
+      if (tblfmt::IsBinary(p, e - p))
+        return (size_t)tblfmt::RecordCount(p, e - p);
+      size_t lines = 0;
+      const char * q = p;
+      while (q != e && (q = (const char*)memchr(q, '\n', e - q)) != 0)
+      {
+        ++lines;
+        ++q;
+      }
+      if (p != e && e[-1] != '\n')
+        ++lines;
+      return lines;
+    }
+
+    // ScanFile scans a whole file image in either format
+    template < class S >
+    void ScanFile (const char* p, const char* e, S& sink)
+    {
+      if (tblfmt::IsBinary(p, e - p))
+        tblfmt::ScanBinary(p + tblfmt::headerSize, tblfmt::RecordsEnd(p, e - p), sink);
+      else
+        ScanRecords(p, e, sink);
+    }
+
+    // KeyMaker turns a scanned key into K through K(const char*): the key
+    // bytes are copied into one reused terminated buffer, then one K is built
+    template < typename K >
+    class KeyMaker
+    {
+    public:
+      KeyMaker () : buffer_(64) {}
+      K operator () (const char* k, size_t klen)
+      {
+        if (buffer_.Size() < klen + 1)
+          buffer_.SetSize(2 * klen + 1);
+        for (size_t i = 0; i < klen; ++i)
+          buffer_[i] = k[i];
+        buffer_[klen] = '\0';
+        return K(&buffer_[0]);
+      }
+    private:
+      fsu::Vector < char > buffer_;
+    } ;
+
+    // BatchSink collects records and hands full batches to T::Insert(b, e)
+    template < class T >
+    class BatchSink
+    {
+    public:
+      typedef fsu::Pair < typename T::KeyType , typename T::DataType > PairType;
+
+      BatchSink (T& table) : table_(table), batch_(batchSize), n_(0), count_(0) {}
+      void operator () (const char* k, size_t klen, long long d)
+      {
+        batch_[n_].first_  = key_(k, klen);
+        batch_[n_].second_ = ToData < typename T::DataType > (d);
+        if (++n_ == batchSize)
+          Flush();
+      }
+      void Flush ()
+      {
+        table_.Insert(batch_.Begin(), batch_.Begin() + n_);
+        count_ += n_;
+        n_ = 0;
+      }
+      size_t Count () const { return count_; }
+    private:
+      T&                                table_;
+      fsu::Vector < PairType >          batch_;
+      size_t                            n_, count_;
+      KeyMaker < typename T::KeyType >  key_;
+    } ;
+  } // namespace tblload
+
+  template < class T >
+  bool LoadTable (const char* filename, T& table, size_t& count, bool presize = 0)
+  {
+    count = 0;
+    fsu::MappedFile file;
+    if (!file.Open(filename))
+      return 0;
+    return LoadTable(file, table, count, presize);
+  }
+
+  template < class T >
+  bool LoadTable (const fsu::MappedFile& file, T& table, size_t& count, bool presize = 0)
+  {
+    count = 0;
+    if (!file.IsOpen())
+      return 0;
+    if (presize && tblfmt::IsBinary(file.Data(), file.Size()))
+      table.Reserve(tblfmt::RecordCount(file.Data(), file.Size()));
+    tblload::BatchSink < T > sink(table);
+    tblload::ScanFile(file.Data(), file.Data() + file.Size(), sink);
+    sink.Flush();
+    count = sink.Count();
+    return 1;
+  }
+
+} // namespace fsu
+
+#endif